@@ -0,0 +1,37 @@
+[VERTEX]
+attribute vec3 a_vertex;
+attribute vec2 a_uv;
+
+uniform mat4 projection_matrix;
+uniform mat4 camera_matrix;
+uniform mat4 object_matrix;
+uniform vec3 object_scale;
+
+varying vec2 v_uv;
+
+void main()
+{
+    gl_Position = projection_matrix * camera_matrix * object_matrix * vec4(a_vertex * object_scale, 1.0);
+    v_uv = a_uv;
+}
+
+[FRAGMENT]
+//The texture holds the full size luma plane, followed by a half height plane of interleaved U V samples for every 2x2 pixels.
+uniform sampler2D texture_map;
+uniform vec4 color;
+uniform vec2 frame_size;
+
+varying vec2 v_uv;
+
+void main()
+{
+    vec2 texture_size = vec2(frame_size.x, frame_size.y * 1.5);
+    vec2 pixel = floor(v_uv * frame_size);
+    vec2 chroma = vec2(floor(pixel.x / 2.0) * 2.0, frame_size.y + floor(pixel.y / 2.0));
+
+    float y = 1.164 * (texture2D(texture_map, (pixel + 0.5) / texture_size).r - 0.0625);
+    float u = texture2D(texture_map, (chroma + vec2(0.5, 0.5)) / texture_size).r - 0.5;
+    float v = texture2D(texture_map, (chroma + vec2(1.5, 0.5)) / texture_size).r - 0.5;
+    vec3 rgb = vec3(y + 1.596 * v, y - 0.392 * u - 0.813 * v, y + 2.017 * u);
+    gl_FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0) * color;
+}
@@ -0,0 +1,35 @@
+[VERTEX]
+attribute vec3 a_vertex;
+attribute vec2 a_uv;
+
+uniform mat4 projection_matrix;
+uniform mat4 camera_matrix;
+uniform mat4 object_matrix;
+uniform vec3 object_scale;
+
+varying vec2 v_uv;
+
+void main()
+{
+    gl_Position = projection_matrix * camera_matrix * object_matrix * vec4(a_vertex * object_scale, 1.0);
+    v_uv = a_uv;
+}
+
+[FRAGMENT]
+//Every texel holds two pixels as Y0 U Y1 V, so pick the Y for the even or odd pixel and share the chroma.
+uniform sampler2D texture_map;
+uniform vec4 color;
+uniform vec2 frame_size;
+
+varying vec2 v_uv;
+
+void main()
+{
+    vec4 yuyv = texture2D(texture_map, v_uv);
+    float odd = mod(floor(v_uv.x * frame_size.x), 2.0);
+    float y = 1.164 * (mix(yuyv.r, yuyv.b, odd) - 0.0625);
+    float u = yuyv.g - 0.5;
+    float v = yuyv.a - 0.5;
+    vec3 rgb = vec3(y + 1.596 * v, y - 0.392 * u - 0.813 * v, y + 2.017 * u);
+    gl_FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0) * color;
+}
@@ -0,0 +1,58 @@
+#include "allocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t allocation_count;
+static thread_local uint64_t allocation_bytes;
+
+
+uint64_t AllocationCounter::getCount()
+{
+    return allocation_count;
+}
+
+uint64_t AllocationCounter::getBytes()
+{
+    return allocation_bytes;
+}
+
+static void* countedAllocate(size_t size)
+{
+    allocation_count++;
+    allocation_bytes += size;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(size_t size)
+{
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return countedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
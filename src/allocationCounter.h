@@ -0,0 +1,16 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+#include <cstddef>
+
+//Counts every call to the global operator new, so the performance test can report the allocation cost of creating and destroying nodes.
+//The counters are per thread, so the build workers do not pollute measurements done on the main thread.
+class AllocationCounter
+{
+public:
+    static uint64_t getCount();
+    static uint64_t getBytes();
+};
+
+#endif//ALLOCATION_COUNTER_H
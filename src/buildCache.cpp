@@ -0,0 +1,67 @@
+#include "buildCache.h"
+#include "fileUtil.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+BuildCache::BuildCache(sp::string build_path)
+: key_file(build_path + "/.arcade_build_key"), build_path(build_path)
+{
+}
+
+sp::string BuildCache::makeKey(sp::string commit, sp::string depends_commit, const std::vector<sp::string>& build_commands)
+{
+    //Without a known commit we cannot tell if the sources changed, so never produce a key that could match.
+    if (commit == "")
+        return "";
+
+    //64 bit FNV-1a over all inputs, separated by a byte that cannot appear in valid UTF-8.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto add = [&hash](const sp::string& data)
+    {
+        for(unsigned char c : data)
+        {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        hash ^= 0xff;
+        hash *= 0x100000001b3ULL;
+    };
+    add(commit);
+    add(depends_commit);
+    for(const sp::string& command : build_commands)
+        add(command.strip());
+
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+    return buffer;
+}
+
+bool BuildCache::isValid(sp::string key, sp::string output_file)
+{
+    if (key == "" || readFileLine(key_file) != key)
+        return false;
+    FILE* f = fopen((build_path + "/" + output_file).c_str(), "rb");
+    if (!f)
+        return false;
+    fclose(f);
+    return true;
+}
+
+void BuildCache::store(sp::string key)
+{
+    if (key == "")
+        return;
+    FILE* f = fopen(key_file.c_str(), "wt");
+    if (f)
+    {
+        fprintf(f, "%s\n", key.c_str());
+        fclose(f);
+    }
+}
+
+void BuildCache::invalidate()
+{
+    remove(key_file.c_str());
+}
@@ -0,0 +1,25 @@
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+#include <sp2/string.h>
+#include <vector>
+
+//Remembers which inputs produced the current contents of a build directory.
+//The key is a hash of the game commit, the depends commit and the build commands, so a change in any of those invalidates the build.
+class BuildCache
+{
+public:
+    BuildCache(sp::string build_path);
+
+    static sp::string makeKey(sp::string commit, sp::string depends_commit, const std::vector<sp::string>& build_commands);
+
+    //True when the build directory was created with this key and the given output file still exists.
+    bool isValid(sp::string key, sp::string output_file);
+    void store(sp::string key);
+    void invalidate();
+private:
+    sp::string key_file;
+    sp::string build_path;
+};
+
+#endif//BUILD_CACHE_H
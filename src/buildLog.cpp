@@ -0,0 +1,103 @@
+#include "buildLog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+void BuildLog::beginCommand(sp::string command)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->command = command;
+    running = true;
+    progress = -1;
+    lines.push_back("$ " + command);
+    while(lines.size() > max_lines)
+        lines.pop_front();
+}
+
+void BuildLog::endCommand(float wall_time, float cpu_time, int exit_status)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    timings.push_back({command, wall_time, cpu_time, exit_status});
+    running = false;
+}
+
+void BuildLog::addLine(sp::string line)
+{
+    if (line.length() > max_line_length)
+        line = line.substr(0, max_line_length);
+    int line_progress = parseProgress(line);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (line_progress >= 0)
+        progress = line_progress;
+    lines.push_back(line);
+    while(lines.size() > max_lines)
+        lines.pop_front();
+}
+
+void BuildLog::setProgress(int percentage)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    progress = percentage;
+}
+
+std::vector<sp::string> BuildLog::getLines()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::vector<sp::string>(lines.begin(), lines.end());
+}
+
+std::vector<BuildLog::CommandTiming> BuildLog::getTimings()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return timings;
+}
+
+sp::string BuildLog::getStatus()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running)
+        return "";
+    if (progress < 0)
+        return command;
+    return command + " " + sp::string(progress) + "%";
+}
+
+float BuildLog::getTotalWallTime()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    float total = 0.0;
+    for(auto& timing : timings)
+        total += timing.wall_time;
+    return total;
+}
+
+void BuildLog::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    lines.clear();
+    timings.clear();
+    running = false;
+    progress = -1;
+}
+
+int BuildLog::parseProgress(const sp::string& line)
+{
+    //make: "[ 45%] Building CXX object ..."
+    //ninja: "[12/40] Building CXX object ..."
+    if (line.length() > 2 && line[0] == '[')
+    {
+        int done, total;
+        if (sscanf(line.c_str(), "[%d%%]", &done) == 1 && line.find("%]") != sp::string::npos)
+            return done;
+        if (sscanf(line.c_str(), "[%d/%d]", &done, &total) == 2 && total > 0)
+            return done * 100 / total;
+        return -1;
+    }
+    //git: "Receiving objects:  45% (450/1000)"
+    auto position = line.find("objects:");
+    if (position != sp::string::npos)
+        return atoi(line.c_str() + position + 8);
+    return -1;
+}
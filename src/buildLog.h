@@ -0,0 +1,50 @@
+#ifndef BUILD_LOG_H
+#define BUILD_LOG_H
+
+#include <sp2/string.h>
+#include <mutex>
+#include <deque>
+#include <vector>
+
+//Output of the git and build commands of a single game, written by a build worker while the main thread shows it.
+//Only the last max_lines lines are kept. Build progress printed by make ("[ 45%]") and ninja ("[12/40]") is picked up from the output.
+class BuildLog
+{
+public:
+    class CommandTiming
+    {
+    public:
+        sp::string command;
+        float wall_time;    //seconds
+        float cpu_time;     //seconds, user and system time of the command and the processes it waited for
+        int exit_status;
+    };
+
+    //Start of a new command, resets the progress.
+    void beginCommand(sp::string command);
+    void endCommand(float wall_time, float cpu_time, int exit_status);
+    void addLine(sp::string line);
+    void setProgress(int percentage);
+
+    std::vector<sp::string> getLines();
+    std::vector<CommandTiming> getTimings();
+    //Short description of what is running, like "make -j4 45%", or an empty string when nothing runs.
+    sp::string getStatus();
+    //Total wall time of all commands since the last clear.
+    float getTotalWallTime();
+    void clear();
+private:
+    static constexpr unsigned int max_lines = 200;
+    static constexpr unsigned int max_line_length = 512;
+
+    static int parseProgress(const sp::string& line);
+
+    std::mutex mutex;
+    std::deque<sp::string> lines;
+    std::vector<CommandTiming> timings;
+    sp::string command;
+    bool running = false;
+    int progress = -1;
+};
+
+#endif//BUILD_LOG_H
@@ -0,0 +1,210 @@
+#include "buildScheduler.h"
+
+//The job the worker on this thread is running.
+static thread_local BuildScheduler::JobId current_job = BuildScheduler::no_job;
+
+BuildScheduler::~BuildScheduler()
+{
+    stop();
+}
+
+void BuildScheduler::start(int worker_count, std::function<void()> worker_init)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = false;
+    for(int n=0; n<worker_count; n++)
+        workers.emplace_back(&BuildScheduler::workerMain, this, worker_init);
+}
+
+void BuildScheduler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for(auto& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+BuildScheduler::JobId BuildScheduler::add(std::function<bool()> function, std::vector<JobId> dependencies, std::function<void()> on_cancel, std::vector<JobId> after)
+{
+    JobId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = jobs.size();
+        jobs.push_back({function, on_cancel, dependencies, State::Waiting, after, false});
+    }
+    condition.notify_one();
+    return id;
+}
+
+BuildScheduler::JobId BuildScheduler::addShared(sp::string key, std::function<bool()> function, std::vector<JobId> dependencies, std::function<void()> on_cancel)
+{
+    JobId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = shared_jobs.find(key);
+        if (it != shared_jobs.end())
+            return it->second;
+        id = jobs.size();
+        jobs.push_back({function, on_cancel, dependencies, State::Waiting, {}, false});
+        shared_jobs[key] = id;
+    }
+    condition.notify_one();
+    return id;
+}
+
+BuildScheduler::JobId BuildScheduler::findShared(sp::string key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = shared_jobs.find(key);
+    if (it == shared_jobs.end())
+        return no_job;
+    return it->second;
+}
+
+void BuildScheduler::releaseCurrentJob()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current_job == no_job)
+            return;
+        jobs[current_job].released = true;
+    }
+    condition.notify_all();
+}
+
+void BuildScheduler::skip(JobId id)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (id == no_job || jobs[id].state != State::Waiting)
+            return;
+        jobs[id].state = State::Done;
+    }
+    condition.notify_all();
+}
+
+bool BuildScheduler::isFinished(JobId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id == no_job)
+        return true;
+    return jobs[id].state == State::Done || jobs[id].state == State::Failed;
+}
+
+void BuildScheduler::prioritize(JobId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    priority_job = id;
+}
+
+void BuildScheduler::setPaused(bool paused)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->paused = paused;
+    }
+    condition.notify_all();
+}
+
+void BuildScheduler::workerMain(std::function<void()> worker_init)
+{
+    if (worker_init)
+        worker_init();
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!stopping)
+    {
+        if (paused)
+        {
+            condition.wait(lock);
+            continue;
+        }
+        std::vector<JobId> cancelled;
+        JobId id = findRunnableJob(cancelled);
+        if (!cancelled.empty())
+        {
+            //Cancelled jobs stay in the running state until their callback is done, so isFinished never returns true too early.
+            std::vector<std::function<void()>> callbacks;
+            for(JobId cancelled_id : cancelled)
+                callbacks.push_back(jobs[cancelled_id].on_cancel);
+            lock.unlock();
+            for(auto& on_cancel : callbacks)
+                if (on_cancel)
+                    on_cancel();
+            lock.lock();
+            for(JobId cancelled_id : cancelled)
+                jobs[cancelled_id].state = State::Failed;
+            condition.notify_all();
+            continue;
+        }
+        if (id == no_job)
+        {
+            condition.wait(lock);
+            continue;
+        }
+
+        jobs[id].state = State::Running;
+        std::function<bool()> function = jobs[id].function;
+        lock.unlock();
+        current_job = id;
+        bool success = function();
+        current_job = no_job;
+        lock.lock();
+        jobs[id].state = success ? State::Done : State::Failed;
+        //Finishing a job can make other jobs runnable or cancelled, so wake up the other workers as well.
+        condition.notify_all();
+    }
+}
+
+BuildScheduler::JobId BuildScheduler::findRunnableJob(std::vector<JobId>& cancelled)
+{
+    std::vector<bool> priority(jobs.size(), false);
+    if (priority_job != no_job)
+        markPriority(priority_job, priority);
+
+    JobId result = no_job;
+    //Jobs that depend on a cancelled job are cancelled in a later pass, once the callback of that job ran.
+    for(JobId id=0; id<JobId(jobs.size()); id++)
+    {
+        Job& job = jobs[id];
+        if (job.state != State::Waiting)
+            continue;
+        bool runnable = true;
+        bool failed = false;
+        for(JobId dependency : job.dependencies)
+        {
+            if (jobs[dependency].state == State::Failed)
+                failed = true;
+            else if (jobs[dependency].state != State::Done)
+                runnable = false;
+        }
+        if (failed)
+        {
+            job.state = State::Running;
+            cancelled.push_back(id);
+            continue;
+        }
+        for(JobId other : job.after)
+            if (jobs[other].state != State::Done && jobs[other].state != State::Failed && !jobs[other].released)
+                runnable = false;
+        if (!runnable)
+            continue;
+        if (result == no_job || (priority[id] && !priority[result]))
+            result = id;
+    }
+    return result;
+}
+
+void BuildScheduler::markPriority(JobId id, std::vector<bool>& priority)
+{
+    if (priority[id])
+        return;
+    priority[id] = true;
+    for(JobId dependency : jobs[id].dependencies)
+        markPriority(dependency, priority);
+    for(JobId other : jobs[id].after)
+        markPriority(other, priority);
+}
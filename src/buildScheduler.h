@@ -0,0 +1,78 @@
+#ifndef BUILD_SCHEDULER_H
+#define BUILD_SCHEDULER_H
+
+#include <sp2/string.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <map>
+#include <vector>
+
+//Runs the git and build jobs of all games on a fixed amount of worker threads.
+//A job only starts when all the jobs it depends on finished successfully. If one of those failed, the job is cancelled instead.
+//Jobs added with a key are only added once, so a depends repository shared by many games is only updated once.
+//A job can also be ordered after other jobs, it then waits for them to finish but runs whether they failed or not,
+//or until they release it with releaseCurrentJob().
+class BuildScheduler
+{
+public:
+    typedef int JobId;
+    static constexpr JobId no_job = -1;
+
+    ~BuildScheduler();
+
+    //worker_init is called on each worker thread before it runs any job.
+    void start(int worker_count, std::function<void()> worker_init=nullptr);
+    //Stop all workers. Running jobs are finished, jobs that did not start yet are dropped.
+    void stop();
+
+    JobId add(std::function<bool()> function, std::vector<JobId> dependencies={}, std::function<void()> on_cancel=nullptr, std::vector<JobId> after={});
+    JobId addShared(sp::string key, std::function<bool()> function, std::vector<JobId> dependencies={}, std::function<void()> on_cancel=nullptr);
+    //Returns the job added with this key, or no_job.
+    JobId findShared(sp::string key);
+    //Called from inside a running job: the jobs ordered after it can start now, without waiting for it to finish.
+    void releaseCurrentJob();
+
+    //Run this job, and the jobs it depends on, before any other job.
+    void prioritize(JobId id);
+    //While paused no new jobs are started, jobs that are running already continue.
+    void setPaused(bool paused);
+    //Drop a job that did not start yet. It counts as done, so jobs that only wait for it still run. A running job is not interrupted.
+    void skip(JobId id);
+    //True when the job finished, failed, was cancelled or skipped, and nothing of it runs anymore.
+    bool isFinished(JobId id);
+private:
+    enum class State
+    {
+        Waiting,
+        Running,
+        Done,
+        Failed
+    };
+    struct Job
+    {
+        std::function<bool()> function;
+        std::function<void()> on_cancel;
+        std::vector<JobId> dependencies;
+        State state;
+        std::vector<JobId> after;
+        bool released;
+    };
+
+    void workerMain(std::function<void()> worker_init);
+    JobId findRunnableJob(std::vector<JobId>& cancelled);
+    void markPriority(JobId id, std::vector<bool>& priority);
+
+    std::vector<Job> jobs;
+    std::map<sp::string, JobId> shared_jobs;
+    JobId priority_job = no_job;
+    bool stopping = false;
+    bool paused = false;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::thread> workers;
+};
+
+#endif//BUILD_SCHEDULER_H
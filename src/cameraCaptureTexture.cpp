@@ -1,14 +1,30 @@
 #include "cameraCaptureTexture.h"
 
+#include <sp2/graphics/opengl.h>
+#include <string.h>
+
 CameraCaptureTexture::CameraCaptureTexture()
 : sp::OpenGLTexture(sp::Texture::Type::Dynamic, "CameraCaptureTexture")
 {
     capture = nullptr;
 }
 
+CameraCaptureTexture::~CameraCaptureTexture()
+{
+    close();
+    deleteRawTexture();
+}
+
 bool CameraCaptureTexture::open(int camera_index)
 {
     close();
+
+    if (raw_capture.open(camera_index))
+    {
+        capturing = true;
+        capture_thread = std::thread(&CameraCaptureTexture::rawCaptureThread, this);
+        return true;
+    }
     
     capture = new sp::io::CameraCapture(camera_index);
     if (capture->getState() != sp::io::CameraCapture::State::Streaming)
@@ -16,30 +32,148 @@ bool CameraCaptureTexture::open(int camera_index)
         close();
         return false;
     }
+    capturing = true;
+    capture_thread = std::thread(&CameraCaptureTexture::captureThread, this);
     return true;
 }
 
 void CameraCaptureTexture::close()
 {
+    capturing = false;
+    if (capture_thread.joinable())
+        capture_thread.join();
     if (capture)
         delete capture;
     capture = nullptr;
+
+    //Closing the raw capture releases all its buffers, so forget about any frame that is still in the triple buffer.
+    raw_capture.close();
+    for(int n=0; n<3; n++)
+        raw_buffers[n] = -1;
+    middle_buffer = middle_buffer & index_mask;
+}
+
+sp::Shader* CameraCaptureTexture::getShader()
+{
+    if (raw_capture.isOpen())
+    {
+        if (raw_capture.getFormat() == V4L2Capture::Format::NV12)
+            return sp::Shader::get("shader/camera_nv12.shader");
+        return sp::Shader::get("shader/camera_yuyv.shader");
+    }
+    return sp::Shader::get("internal:basic.shader");
 }
 
 void CameraCaptureTexture::bind()
 {
-    if (capture)
+    if (middle_buffer.load(std::memory_order_relaxed) & new_frame_flag)
     {
-        sp::Image image(capture->getFrame());
-        if (image.getSize().x > 0)
-            setImage(std::move(image));
+        front_buffer = middle_buffer.exchange(front_buffer, std::memory_order_acq_rel) & index_mask;
+        if (buffer_sequence[front_buffer] != uploaded_sequence)
+        {
+            uploaded_sequence = buffer_sequence[front_buffer];
+            if (raw_buffers[front_buffer] >= 0)
+                uploadRawFrame(raw_capture.getData(raw_buffers[front_buffer]));
+            else
+                setImage(std::move(buffers[front_buffer]));
+        }
+    }
+    if (raw_capture.isOpen())
+    {
+        glBindTexture(GL_TEXTURE_2D, raw_texture);
+        //The conversion shaders need the frame size to find the chroma samples that belong to a pixel.
+        GLint program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        if (program)
+            glUniform2f(glGetUniformLocation(program, "frame_size"), raw_capture.getSize().x, raw_capture.getSize().y);
+        return;
     }
     sp::OpenGLTexture::bind();
 }
 
-sp::Image CameraCaptureTexture::getFrame()
+void CameraCaptureTexture::uploadRawFrame(const uint8_t* data)
 {
-    if (capture)
-        return capture->getFrame();
-    return sp::Image();
+    sp::Vector2i size = raw_capture.getSize();
+    bool nv12 = raw_capture.getFormat() == V4L2Capture::Format::NV12;
+    //YUYV is uploaded as RGBA with one texel per two pixels, NV12 as a single luminance texture with the chroma plane below the luma plane.
+    sp::Vector2i texture_size = nv12 ? sp::Vector2i(size.x, size.y * 3 / 2) : sp::Vector2i(size.x / 2, size.y);
+    GLenum texture_format = nv12 ? GL_LUMINANCE : GL_RGBA;
+    size_t frame_bytes = size_t(raw_capture.getStride()) * texture_size.y;
+
+    if (!raw_texture || raw_texture_size != texture_size)
+    {
+        deleteRawTexture();
+        glGenTextures(1, &raw_texture);
+        glBindTexture(GL_TEXTURE_2D, raw_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, texture_format, texture_size.x, texture_size.y, 0, texture_format, GL_UNSIGNED_BYTE, nullptr);
+        glGenBuffers(pixel_buffer_count, pixel_buffers);
+        raw_texture_size = texture_size;
+    }
+
+    //Cycle through the pixel buffers and orphan the storage before mapping it, so we never wait for the driver to finish a previous upload.
+    pixel_buffer_index = (pixel_buffer_index + 1) % pixel_buffer_count;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffers[pixel_buffer_index]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, frame_bytes, nullptr, GL_STREAM_DRAW);
+    void* target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frame_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (target)
+    {
+        memcpy(target, data, frame_bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glBindTexture(GL_TEXTURE_2D, raw_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, nv12 ? raw_capture.getStride() : raw_capture.getStride() / 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture_size.x, texture_size.y, texture_format, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void CameraCaptureTexture::deleteRawTexture()
+{
+    if (!raw_texture)
+        return;
+    glDeleteTextures(1, &raw_texture);
+    glDeleteBuffers(pixel_buffer_count, pixel_buffers);
+    raw_texture = 0;
+}
+
+void CameraCaptureTexture::captureThread()
+{
+    while(capturing)
+    {
+        sp::Image image(capture->getFrame());
+        if (image.getSize().x <= 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        buffers[back_buffer] = std::move(image);
+        buffer_sequence[back_buffer] = ++capture_sequence;
+        back_buffer = middle_buffer.exchange(back_buffer | new_frame_flag, std::memory_order_acq_rel) & index_mask;
+    }
+}
+
+void CameraCaptureTexture::rawCaptureThread()
+{
+    while(capturing)
+    {
+        int index = raw_capture.dequeue(100);
+        if (index < 0)
+            continue;
+        raw_buffers[back_buffer] = index;
+        buffer_sequence[back_buffer] = ++capture_sequence;
+        back_buffer = middle_buffer.exchange(back_buffer | new_frame_flag, std::memory_order_acq_rel) & index_mask;
+        //We got back either a frame the render thread skipped, or one it already uploaded. In both cases the driver can have it again.
+        if (raw_buffers[back_buffer] >= 0)
+        {
+            raw_capture.enqueue(raw_buffers[back_buffer]);
+            raw_buffers[back_buffer] = -1;
+        }
+    }
 }
@@ -2,21 +2,61 @@
 #define CAMERA_CAPTURE_TEXTURE_H
 
 #include <sp2/graphics/texture.h>
+#include <sp2/graphics/shader.h>
 #include <sp2/io/cameraCapture.h>
+#include <atomic>
+#include <thread>
 
+#include "v4l2Capture.h"
+
+//Texture showing the live camera image.
+//Frames are captured on a background thread and handed to the render thread with a lock-free triple buffer,
+//so binding the texture never waits on the camera and only uploads when there is a new frame.
+//
+//When the camera supports it, raw YUYV or NV12 frames are used. Those are copied into a ring of pixel buffer objects
+//and uploaded asynchronously, and converted to RGB by the shader from getShader().
+//Else the frames are converted to RGBA on the CPU by sp::io::CameraCapture.
 class CameraCaptureTexture : public sp::OpenGLTexture
 {
 public:
     CameraCaptureTexture();
+    ~CameraCaptureTexture();
     
     bool open(int camera_index);
     void close();
 
     virtual void bind() override;
-    
-    sp::Image getFrame();
+    //Shader to render this texture with, depends on the format the camera delivers.
+    sp::Shader* getShader();
 private:
+    void captureThread();
+    void rawCaptureThread();
+    void uploadRawFrame(const uint8_t* data);
+    void deleteRawTexture();
+
+    static constexpr int new_frame_flag = 4;
+    static constexpr int index_mask = 3;
+    static constexpr int pixel_buffer_count = 3;
+
     sp::io::CameraCapture* capture;
+    V4L2Capture raw_capture;
+    std::thread capture_thread;
+    std::atomic<bool> capturing{false};
+
+    sp::Image buffers[3];
+    int raw_buffers[3] = {-1, -1, -1};
+    uint64_t buffer_sequence[3] = {0, 0, 0};
+    //Index of the buffer that is shared between the threads, with new_frame_flag set when the capture thread just put a frame in it.
+    std::atomic<int> middle_buffer{2};
+    int back_buffer = 0;    //Only used by the capture thread
+    int front_buffer = 1;   //Only used by the render thread
+    uint64_t capture_sequence = 0;
+    uint64_t uploaded_sequence = 0;
+
+    unsigned int raw_texture = 0;
+    sp::Vector2i raw_texture_size;
+    unsigned int pixel_buffers[pixel_buffer_count] = {0, 0, 0};
+    int pixel_buffer_index = 0;
 };
 
 #endif//CAMERA_CAPTURE_TEXTURE_H
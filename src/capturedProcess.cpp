@@ -0,0 +1,167 @@
+#include "capturedProcess.h"
+#include "buildLog.h"
+
+#include <sp2/logging.h>
+
+#ifdef __WIN32__
+#include <sp2/io/subprocess.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <errno.h>
+
+extern char** environ;
+#endif//__WIN32__
+#include <chrono>
+
+CapturedProcess::Hooks* CapturedProcess::hooks = nullptr;
+
+
+CapturedProcess::CapturedProcess(std::vector<sp::string> command, sp::string working_directory)
+: command(command), working_directory(working_directory)
+{
+}
+
+void CapturedProcess::setHooks(Hooks* hooks)
+{
+    CapturedProcess::hooks = hooks;
+}
+
+void CapturedProcess::setEnvironment(sp::string key, sp::string value)
+{
+    environment.emplace_back(key, value);
+}
+
+#ifdef __WIN32__
+//Without fork and pipes the output is not captured, only the exit status and wall time end up in the log.
+//Environment variables are not passed on either.
+int CapturedProcess::run(BuildLog& log)
+{
+    sp::string command_line;
+    for(auto& part : command)
+        command_line += (command_line == "" ? "" : " ") + part;
+    log.beginCommand(command_line);
+    auto start = std::chrono::steady_clock::now();
+    if (command.empty())
+    {
+        log.endCommand(0.0, 0.0, -1);
+        return -1;
+    }
+    sp::io::Subprocess process(command, working_directory);
+    int exit_status = process.wait();
+    float wall_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    log.endCommand(wall_time, 0.0, exit_status);
+    LOG(Info, command_line, "finished with", exit_status, "after", wall_time, "seconds");
+    return exit_status;
+}
+#else
+int CapturedProcess::run(BuildLog& log)
+{
+    sp::string command_line;
+    for(auto& part : command)
+        command_line += (command_line == "" ? "" : " ") + part;
+    log.beginCommand(command_line);
+    auto start = std::chrono::steady_clock::now();
+
+    int pipe_fds[2];
+    if (command.empty() || pipe2(pipe_fds, O_CLOEXEC) < 0)
+    {
+        log.endCommand(0.0, 0.0, -1);
+        return -1;
+    }
+    //Build the argument list before forking, only async-signal-safe calls are allowed in the child.
+    std::vector<char*> argv;
+    for(auto& part : command)
+        argv.push_back(const_cast<char*>(part.c_str()));
+    argv.push_back(nullptr);
+    std::vector<sp::string> environment_strings;
+    for(auto& it : environment)
+        environment_strings.push_back(it.first + "=" + it.second);
+    std::vector<char*> envp;
+    for(char** env = environ; *env; env++)
+    {
+        bool replaced = false;
+        for(auto& it : environment)
+            if (sp::string(*env).startswith(it.first + "="))
+                replaced = true;
+        if (!replaced)
+            envp.push_back(*env);
+    }
+    for(auto& env : environment_strings)
+        envp.push_back(const_cast<char*>(env.c_str()));
+    envp.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        log.addLine("Failed to start " + command_line);
+        log.endCommand(0.0, 0.0, -1);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        //Own process group, so the command and everything it starts can be paused together.
+        setpgid(0, 0);
+        if (hooks)
+            hooks->onChildStart();
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        dup2(pipe_fds[1], STDERR_FILENO);
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0)
+            dup2(null_fd, STDIN_FILENO);
+        if (working_directory == "" || chdir(working_directory.c_str()) == 0)
+            execvpe(argv[0], argv.data(), envp.data());
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+    setpgid(pid, pid);
+    if (hooks)
+        hooks->onStarted(pid);
+
+    //Both newlines and carriage returns end a line, git redraws its progress with carriage returns.
+    sp::string line;
+    char buffer[4096];
+    while(true)
+    {
+        ssize_t size = read(pipe_fds[0], buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            break;
+        for(ssize_t n=0; n<size; n++)
+        {
+            if (buffer[n] == '\n' || buffer[n] == '\r')
+            {
+                if (line != "")
+                    log.addLine(line);
+                line = "";
+            }
+            else
+            {
+                line += buffer[n];
+            }
+        }
+    }
+    if (line != "")
+        log.addLine(line);
+    close(pipe_fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    while(wait4(pid, &status, 0, &usage) < 0 && errno == EINTR)
+    {
+    }
+    if (hooks)
+        hooks->onFinished(pid);
+    float wall_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    float cpu_time = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+    int exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    log.endCommand(wall_time, cpu_time, exit_status);
+    LOG(Info, command_line, "finished with", exit_status, "after", wall_time, "seconds,", cpu_time, "seconds cpu");
+    return exit_status;
+}
+#endif//__WIN32__
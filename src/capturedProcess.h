@@ -0,0 +1,42 @@
+#ifndef CAPTURED_PROCESS_H
+#define CAPTURED_PROCESS_H
+
+#include <sp2/string.h>
+#include <vector>
+#include <sys/types.h>
+
+class BuildLog;
+
+//Runs a command to completion, streaming its stdout and stderr line by line into a build log, and records how long it took.
+//Used for the git and build commands instead of sp::io::Subprocess, which does not give access to the output.
+class CapturedProcess
+{
+public:
+    //Called for every process that is started, so the resource governor can keep an eye on them. Not used on Windows.
+    class Hooks
+    {
+    public:
+        //Called in the child process before exec, so only async-signal-safe calls are allowed.
+        virtual void onChildStart() = 0;
+        virtual void onStarted(pid_t pid) = 0;
+        virtual void onFinished(pid_t pid) = 0;
+    };
+
+    CapturedProcess(std::vector<sp::string> command, sp::string working_directory="");
+
+    static void setHooks(Hooks* hooks);
+
+    //Set an environment variable for the command, on top of the environment of the launcher.
+    void setEnvironment(sp::string key, sp::string value);
+
+    //Returns the exit status of the command, or -1 when it could not be started or was killed by a signal.
+    int run(BuildLog& log);
+private:
+    std::vector<sp::string> command;
+    sp::string working_directory;
+    std::vector<std::pair<sp::string, sp::string>> environment;
+
+    static Hooks* hooks;
+};
+
+#endif//CAPTURED_PROCESS_H
@@ -0,0 +1,281 @@
+#include "catalog.h"
+#include "fileUtil.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/keyValueTreeLoader.h>
+#include <sp2/io/resourceProvider.h>
+#include <sp2/io/filesystem.h>
+
+#ifndef __WIN32__
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif//__WIN32__
+#include <stdio.h>
+#include <string.h>
+
+static const char catalog_magic[8] = {'A', 'R', 'C', 'C', 'A', 'T', 'L', '1'};
+
+
+bool CatalogEntry::operator==(const CatalogEntry& other) const
+{
+    return name == other.name && exec == other.exec && git == other.git && depends_path == other.depends_path
+        && depends_repo == other.depends_repo && build_commands == other.build_commands;
+}
+
+bool Catalog::load(sp::string resource_name, std::vector<CatalogEntry>& entries)
+{
+    sp::io::ResourceStreamPtr stream = sp::io::ResourceProvider::get(resource_name);
+    if (!stream)
+        return false;
+    //64 bit FNV-1a over the text, reading it is cheap compared to parsing it.
+    uint64_t source_hash = 0xcbf29ce484222325ULL;
+    for(char c : stream->readAll())
+    {
+        source_hash ^= uint8_t(c);
+        source_hash *= 0x100000001b3ULL;
+    }
+
+    sp::string index_filename = getIndexFilename(resource_name);
+    if (loadIndex(index_filename, source_hash, entries))
+        return true;
+    if (!parse(resource_name, entries))
+        return false;
+    storeIndex(index_filename, source_hash, entries);
+    return true;
+}
+
+bool Catalog::parse(sp::string resource_name, std::vector<CatalogEntry>& entries)
+{
+    sp::KeyValueTreePtr tree = sp::io::KeyValueTreeLoader::loadResource(resource_name);
+    if (!tree)
+        return false;
+    entries.clear();
+    for(auto& it : tree->getFlattenNodesByIds())
+    {
+        CatalogEntry entry;
+        entry.name = it.first;
+        entry.exec = it.second["exec"];
+        entry.git = it.second["git"];
+        std::vector<sp::string> depends = it.second["depends"].split(" ");
+        if (depends.size() > 1)
+        {
+            entry.depends_path = depends[0];
+            entry.depends_repo = depends[1];
+        }
+        entry.build_commands = it.second["build"].split("\n");
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+bool Catalog::loadIndex(sp::string filename, uint64_t source_hash, std::vector<CatalogEntry>& entries)
+{
+#ifdef __WIN32__
+    //No mmap, read the whole index instead. Still saves parsing the text.
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    std::vector<uint64_t> buffer;
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bool read_ok = file_size >= long(sizeof(Header));
+    if (read_ok)
+    {
+        buffer.resize((file_size + 7) / 8);
+        read_ok = fread(buffer.data(), file_size, 1, f) == 1;
+    }
+    fclose(f);
+    if (!read_ok)
+        return false;
+    const void* data = buffer.data();
+    size_t size = file_size;
+#else
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || size_t(info.st_size) < sizeof(Header))
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+#endif//__WIN32__
+
+    const Header* header = static_cast<const Header*>(data);
+    const Record* records = reinterpret_cast<const Record*>(header + 1);
+    const StringRef* commands = reinterpret_cast<const StringRef*>(records + header->entry_count);
+    const char* strings = reinterpret_cast<const char*>(commands + header->command_count);
+    bool valid = memcmp(header->magic, catalog_magic, sizeof(catalog_magic)) == 0
+        && header->source_hash == source_hash
+        && size == sizeof(Header) + size_t(header->entry_count) * sizeof(Record)
+            + size_t(header->command_count) * sizeof(StringRef) + header->string_table_size;
+    //Every reference is checked, so a corrupt index is recompiled instead of read out of bounds.
+    auto check = [header](const StringRef& ref)
+    {
+        return size_t(ref.offset) + ref.length <= header->string_table_size;
+    };
+    for(uint32_t n=0; valid && n<header->entry_count; n++)
+    {
+        const Record& record = records[n];
+        valid = check(record.name) && check(record.exec) && check(record.git) && check(record.depends_path) && check(record.depends_repo)
+            && size_t(record.first_command) + record.command_count <= header->command_count;
+        for(uint32_t c=0; valid && c<record.command_count; c++)
+            valid = check(commands[record.first_command + c]);
+    }
+    if (valid)
+    {
+        auto get = [strings](const StringRef& ref)
+        {
+            return sp::string(std::string(strings + ref.offset, ref.length));
+        };
+        entries.clear();
+        entries.reserve(header->entry_count);
+        for(uint32_t n=0; n<header->entry_count; n++)
+        {
+            const Record& record = records[n];
+            CatalogEntry entry;
+            entry.name = get(record.name);
+            entry.exec = get(record.exec);
+            entry.git = get(record.git);
+            entry.depends_path = get(record.depends_path);
+            entry.depends_repo = get(record.depends_repo);
+            for(uint32_t c=0; c<record.command_count; c++)
+                entry.build_commands.push_back(get(commands[record.first_command + c]));
+            entries.push_back(std::move(entry));
+        }
+    }
+#ifndef __WIN32__
+    munmap(data, size);
+#endif//__WIN32__
+    return valid;
+}
+
+void Catalog::storeIndex(sp::string filename, uint64_t source_hash, const std::vector<CatalogEntry>& entries)
+{
+    std::vector<Record> records;
+    std::vector<StringRef> commands;
+    std::string strings;
+    auto add = [&strings](const sp::string& str)
+    {
+        StringRef ref{uint32_t(strings.size()), uint32_t(str.size())};
+        strings += str;
+        return ref;
+    };
+    for(auto& entry : entries)
+    {
+        Record record;
+        record.name = add(entry.name);
+        record.exec = add(entry.exec);
+        record.git = add(entry.git);
+        record.depends_path = add(entry.depends_path);
+        record.depends_repo = add(entry.depends_repo);
+        record.first_command = commands.size();
+        record.command_count = entry.build_commands.size();
+        for(auto& command : entry.build_commands)
+            commands.push_back(add(command));
+        records.push_back(record);
+    }
+
+    Header header;
+    memcpy(header.magic, catalog_magic, sizeof(catalog_magic));
+    header.source_hash = source_hash;
+    header.entry_count = records.size();
+    header.command_count = commands.size();
+    header.string_table_size = strings.size();
+    header.reserved = 0;
+
+    sp::io::makeDirectory("_catalog");
+    FILE* f = fopen((filename + ".tmp").c_str(), "wb");
+    if (!f)
+        return;
+    bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+    success = success && fwrite(records.data(), sizeof(Record), records.size(), f) == records.size();
+    success = success && fwrite(commands.data(), sizeof(StringRef), commands.size(), f) == commands.size();
+    success = success && fwrite(strings.data(), 1, strings.size(), f) == strings.size();
+    success = fclose(f) == 0 && success;
+    if (!success || !replaceFile(filename + ".tmp", filename))
+    {
+        LOG(Warning, "Failed to store catalog index", filename);
+        remove((filename + ".tmp").c_str());
+    }
+}
+
+sp::string Catalog::getIndexFilename(sp::string resource_name)
+{
+    return "_catalog/" + resource_name + ".index";
+}
+
+#ifdef __WIN32__
+CatalogWatcher::CatalogWatcher(sp::string filename, std::vector<sp::string> directories)
+: filename(filename)
+{
+    modify_time = sp::io::ResourceProvider::getModifyTime(filename);
+}
+
+CatalogWatcher::~CatalogWatcher()
+{
+}
+
+bool CatalogWatcher::hasChanged()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_check)
+        return false;
+    next_check = now + std::chrono::seconds(2);
+    auto time = sp::io::ResourceProvider::getModifyTime(filename);
+    if (time == modify_time)
+        return false;
+    modify_time = time;
+    return true;
+}
+#else
+CatalogWatcher::CatalogWatcher(sp::string filename, std::vector<sp::string> directories)
+: filename(filename)
+{
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG(Warning, "Failed to watch", filename, "for changes");
+        return;
+    }
+    for(auto& directory : directories)
+        inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+}
+
+CatalogWatcher::~CatalogWatcher()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool CatalogWatcher::hasChanged()
+{
+    if (fd < 0)
+        return false;
+    bool changed = false;
+    alignas(inotify_event) char buffer[4096];
+    while(true)
+    {
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        if (size <= 0)
+            break;
+        for(char* ptr = buffer; ptr < buffer + size; )
+        {
+            inotify_event* event = reinterpret_cast<inotify_event*>(ptr);
+            if (event->len > 0 && filename == event->name)
+                changed = true;
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+#endif//__WIN32__
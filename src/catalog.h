@@ -0,0 +1,89 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <sp2/string.h>
+#include <vector>
+#include <stdint.h>
+#ifdef __WIN32__
+#include <chrono>
+#endif//__WIN32__
+
+//A single game from games.txt or beta_games.txt.
+class CatalogEntry
+{
+public:
+    sp::string name;
+    sp::string exec;
+    sp::string git;
+    sp::string depends_path;
+    sp::string depends_repo;
+    std::vector<sp::string> build_commands;
+
+    bool operator==(const CatalogEntry& other) const;
+    bool operator!=(const CatalogEntry& other) const { return !(*this == other); }
+};
+
+//Loads the catalog files. The parsed catalog is compiled into a binary index in _catalog, which is mmapped on later boots
+//instead of parsing the text again, for as long as the hash of the text file still matches.
+class Catalog
+{
+public:
+    //Returns false when the file could not be loaded, so a half written file does not remove every game.
+    static bool load(sp::string resource_name, std::vector<CatalogEntry>& entries);
+private:
+    class StringRef
+    {
+    public:
+        uint32_t offset;
+        uint32_t length;
+    };
+    class Header
+    {
+    public:
+        char magic[8];
+        uint64_t source_hash;
+        uint32_t entry_count;
+        uint32_t command_count;
+        uint32_t string_table_size;
+        uint32_t reserved;
+    };
+    //Fixed size record per game, followed by command_count StringRefs for the build commands and then the string table.
+    class Record
+    {
+    public:
+        StringRef name;
+        StringRef exec;
+        StringRef git;
+        StringRef depends_path;
+        StringRef depends_repo;
+        uint32_t first_command;
+        uint32_t command_count;
+    };
+
+    static bool parse(sp::string resource_name, std::vector<CatalogEntry>& entries);
+    static bool loadIndex(sp::string filename, uint64_t source_hash, std::vector<CatalogEntry>& entries);
+    static void storeIndex(sp::string filename, uint64_t source_hash, const std::vector<CatalogEntry>& entries);
+    static sp::string getIndexFilename(sp::string resource_name);
+};
+
+//Watches a catalog file with inotify. The directories are watched instead of the file itself,
+//as editors often save by writing a new file and renaming it over the old one.
+//Without inotify (on Windows) the modification time of the file is checked every few seconds instead.
+class CatalogWatcher
+{
+public:
+    CatalogWatcher(sp::string filename, std::vector<sp::string> directories);
+    ~CatalogWatcher();
+
+    //True when the file was written since the last call. Never blocks, called every frame.
+    bool hasChanged();
+private:
+    sp::string filename;
+    int fd = -1;
+#ifdef __WIN32__
+    std::chrono::steady_clock::time_point next_check;
+    std::chrono::system_clock::time_point modify_time;
+#endif//__WIN32__
+};
+
+#endif//CATALOG_H
@@ -0,0 +1,116 @@
+#include "compilerCache.h"
+#include "capturedProcess.h"
+#include "fileUtil.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/filesystem.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef __WIN32__
+#include <unistd.h>
+#include <limits.h>
+#endif//__WIN32__
+
+
+#ifndef __WIN32__
+static sp::string findExecutable(sp::string name)
+{
+    const char* path = getenv("PATH");
+    if (!path)
+        return "";
+    for(sp::string part : sp::string(path).split(":"))
+    {
+        sp::string filename = part + "/" + name;
+        if (access(filename.c_str(), X_OK) == 0)
+            return filename;
+    }
+    return "";
+}
+#endif//__WIN32__
+
+CompilerCache::CompilerCache(sp::string directory)
+{
+    //This runs before main, so the reason the cache is off is only logged once the first build runs.
+#ifdef __WIN32__
+    //Build commands cannot be given their own environment on Windows, so ccache would not find the shared cache.
+    status = "Compiler cache is not supported on Windows, games are built without it";
+#else
+    const char* env = getenv("ARCADE_CCACHE");
+    if (env && sp::string(env) == "0")
+    {
+        status = "Compiler cache disabled by ARCADE_CCACHE=0";
+        return;
+    }
+    ccache = findExecutable("ccache");
+    if (ccache == "")
+    {
+        status = "ccache not found in PATH, games are built without a shared compiler cache";
+        return;
+    }
+    char buffer[PATH_MAX];
+    if (!getcwd(buffer, sizeof(buffer)))
+    {
+        ccache = "";
+        status = "Failed to get the working directory, games are built without a shared compiler cache";
+        return;
+    }
+    base_directory = buffer;
+    this->directory = base_directory + "/" + directory;
+#endif//__WIN32__
+}
+
+std::vector<sp::string> CompilerCache::prepareCommand(std::vector<sp::string> command)
+{
+    std::call_once(status_logged, [this]()
+    {
+        if (isAvailable())
+            LOG(Info, "Sharing compiled objects between games with", ccache, "in", directory);
+        else
+            LOG(Warning, status);
+    });
+    if (!isAvailable() || command.empty() || command[0] != "cmake")
+        return command;
+    for(auto& part : command)
+        if (part.startswith("-DCMAKE_CXX_COMPILER_LAUNCHER") || part.startswith("-DCMAKE_C_COMPILER_LAUNCHER"))
+            return command;
+    command.push_back("-DCMAKE_C_COMPILER_LAUNCHER=" + ccache);
+    command.push_back("-DCMAKE_CXX_COMPILER_LAUNCHER=" + ccache);
+    return command;
+}
+
+void CompilerCache::setEnvironment(CapturedProcess& process)
+{
+    if (!isAvailable())
+        return;
+    process.setEnvironment("CCACHE_DIR", directory);
+    process.setEnvironment("CCACHE_BASEDIR", base_directory);
+    //Every game has its own build directory, which would otherwise end up in the hash of debug builds.
+    process.setEnvironment("CCACHE_NOHASHDIR", "1");
+}
+
+bool CompilerCache::isPrimed(sp::string depends_path, sp::string depends_commit)
+{
+    if (!isAvailable() || depends_commit == "")
+        return false;
+    return readFileLine(getPrimedFilename(depends_path)) == depends_commit;
+}
+
+void CompilerCache::setPrimed(sp::string depends_path, sp::string depends_commit)
+{
+    if (!isAvailable() || depends_commit == "")
+        return;
+    sp::io::makeDirectory(directory);
+    sp::string filename = getPrimedFilename(depends_path);
+    FILE* f = fopen((filename + ".tmp").c_str(), "wt");
+    if (!f)
+        return;
+    fprintf(f, "%s\n", depends_commit.c_str());
+    if (fclose(f) != 0 || !replaceFile(filename + ".tmp", filename))
+        remove((filename + ".tmp").c_str());
+}
+
+sp::string CompilerCache::getPrimedFilename(sp::string depends_path)
+{
+    return directory + "/arcade_primed_" + depends_path.replace("/", "_");
+}
@@ -0,0 +1,38 @@
+#ifndef COMPILER_CACHE_H
+#define COMPILER_CACHE_H
+
+#include <sp2/string.h>
+#include <vector>
+#include <mutex>
+
+class CapturedProcess;
+
+//Shares compiled objects between the builds of all games through ccache.
+//Games that depend on the same engine each compile the engine sources as part of their own build, with a shared cache
+//only the first of those builds really compiles the engine, the others get the objects from the cache.
+class CompilerCache
+{
+public:
+    CompilerCache(sp::string directory);
+
+    bool isAvailable() { return ccache != ""; }
+    //True once a build of this depends group succeeded with the cache at this depends commit, so its engine objects are in there.
+    //Can be called from any thread.
+    bool isPrimed(sp::string depends_path, sp::string depends_commit);
+    void setPrimed(sp::string depends_path, sp::string depends_commit);
+
+    //Add the compiler launcher to cmake configure commands, other commands are returned as they are.
+    std::vector<sp::string> prepareCommand(std::vector<sp::string> command);
+    //Point ccache at the shared cache, with paths relative to the launcher directory so the same engine source gives the same hash in every game.
+    void setEnvironment(CapturedProcess& process);
+private:
+    sp::string getPrimedFilename(sp::string depends_path);
+
+    sp::string ccache;
+    sp::string status;  //Why the cache is not used, logged at the first build
+    std::once_flag status_logged;
+    sp::string directory;
+    sp::string base_directory;
+};
+
+#endif//COMPILER_CACHE_H
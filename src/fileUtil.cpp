@@ -0,0 +1,29 @@
+#include "fileUtil.h"
+
+#include <stdio.h>
+#ifdef __WIN32__
+#include <windows.h>
+#endif//__WIN32__
+
+
+sp::string readFileLine(sp::string filename)
+{
+    FILE* f = fopen(filename.c_str(), "rt");
+    if (!f)
+        return "";
+    char buffer[256];
+    sp::string result;
+    if (fgets(buffer, sizeof(buffer), f))
+        result = sp::string(buffer).strip();
+    fclose(f);
+    return result;
+}
+
+bool replaceFile(sp::string source, sp::string target)
+{
+#ifdef __WIN32__
+    return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(source.c_str(), target.c_str()) == 0;
+#endif//__WIN32__
+}
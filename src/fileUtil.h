@@ -0,0 +1,13 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <sp2/string.h>
+
+//Returns the first line of a small text file without surrounding whitespace, or an empty string when it cannot be read.
+//Used for git refs and build keys, which are a single line.
+sp::string readFileLine(sp::string filename);
+//Move source to target, replacing target when it exists. Files are written next to their final name and moved into place
+//with this, so a reader, or a cut power, never sees a half written file. rename() cannot replace a file on Windows.
+bool replaceFile(sp::string source, sp::string target);
+
+#endif//FILE_UTIL_H
@@ -0,0 +1,107 @@
+#include "gameStateStore.h"
+#include "fileUtil.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/keyValueTreeLoader.h>
+
+#include <sys/stat.h>
+#include <stdio.h>
+
+
+GameStateStore::GameStateStore(sp::string filename)
+: filename(filename)
+{
+}
+
+void GameStateStore::load()
+{
+    FILE* f = fopen(filename.c_str(), "rt");
+    if (!f)
+        return;
+    fclose(f);
+
+    auto tree = sp::io::KeyValueTreeLoader::loadResource(filename);
+    if (!tree)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto& it : tree->getFlattenNodesByIds())
+    {
+        Record record;
+        record.commit = it.second["commit"];
+        record.build_key = it.second["build_key"];
+        record.binary = it.second["binary"];
+        records[it.first] = record;
+    }
+}
+
+bool GameStateStore::get(sp::string name, Record& record)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = records.find(name);
+    if (it == records.end())
+        return false;
+    record = it->second;
+    return true;
+}
+
+void GameStateStore::set(sp::string name, const Record& record)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    records[name] = record;
+    save();
+}
+
+void GameStateStore::save()
+{
+    FILE* f = fopen((filename + ".tmp").c_str(), "wt");
+    if (!f)
+        return;
+    for(auto& it : records)
+    {
+        fprintf(f, "[%s] {\n", it.first.c_str());
+        fprintf(f, "    commit: %s\n", it.second.commit.c_str());
+        fprintf(f, "    build_key: %s\n", it.second.build_key.c_str());
+        fprintf(f, "    binary: %s\n", it.second.binary.c_str());
+        fprintf(f, "}\n");
+    }
+    if (fclose(f) != 0 || !replaceFile(filename + ".tmp", filename))
+        LOG(Warning, "Failed to save game state to", filename);
+}
+
+bool GameStateStore::installBinary(sp::string source, sp::string target)
+{
+    struct stat info;
+    if (stat(source.c_str(), &info) < 0)
+        return false;
+    FILE* in = fopen(source.c_str(), "rb");
+    if (!in)
+        return false;
+    sp::string temp = target + ".tmp";
+    FILE* out = fopen(temp.c_str(), "wb");
+    if (!out)
+    {
+        fclose(in);
+        return false;
+    }
+    bool success = true;
+    char buffer[64 * 1024];
+    size_t size;
+    while((size = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    {
+        if (fwrite(buffer, 1, size, out) != size)
+        {
+            success = false;
+            break;
+        }
+    }
+    fclose(in);
+    success = fclose(out) == 0 && success;
+    success = success && chmod(temp.c_str(), info.st_mode & 07777) == 0;
+    success = success && replaceFile(temp, target);
+    if (!success)
+    {
+        LOG(Error, "Failed to install", source, "to", target);
+        remove(temp.c_str());
+    }
+    return success;
+}
@@ -0,0 +1,39 @@
+#ifndef GAME_STATE_STORE_H
+#define GAME_STATE_STORE_H
+
+#include <sp2/string.h>
+#include <mutex>
+#include <map>
+
+//Remembers the last build of every game that was known to work, across launcher restarts.
+//Games with a known good build can be played right after boot, while they are updated in the background.
+class GameStateStore
+{
+public:
+    class Record
+    {
+    public:
+        sp::string commit;
+        sp::string build_key;
+        sp::string binary;
+    };
+
+    GameStateStore(sp::string filename);
+
+    void load();
+    bool get(sp::string name, Record& record);
+    //Update the record of a game and write all records to disk. Can be called from any thread.
+    void set(sp::string name, const Record& record);
+
+    //Copy a freshly built executable to the place it is run from. The copy is renamed into place,
+    //so a game that is still running from the old executable is not affected.
+    static bool installBinary(sp::string source, sp::string target);
+private:
+    void save();
+
+    sp::string filename;
+    std::mutex mutex;
+    std::map<sp::string, Record> records;
+};
+
+#endif//GAME_STATE_STORE_H
@@ -0,0 +1,344 @@
+#include "gameSupervisor.h"
+#include "unfocusedKeyInfo.h"
+
+#include <sp2/logging.h>
+
+#ifndef __WIN32__
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#endif//__WIN32__
+#include <chrono>
+#include <cmath>
+
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef __WIN32__
+GameSupervisor::GameSupervisor(UnfocusedKeyMonitor& key_monitor)
+: key_monitor(key_monitor)
+{
+    key_monitor.setExitCallback([this]() { wake(); });
+    thread = std::thread(&GameSupervisor::run, this);
+}
+
+GameSupervisor::~GameSupervisor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        if (process)
+            process->kill(true);
+        process = nullptr;
+        pid = 0;
+    }
+    wake();
+    thread.join();
+}
+
+bool GameSupervisor::launch(sp::string executable, sp::string working_directory, float inactivity_timeout)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pid > 0)
+        return false;
+
+    process = std::unique_ptr<sp::io::Subprocess>(new sp::io::Subprocess({executable}, working_directory));
+    pid = 1;
+    this->inactivity_timeout = inactivity_timeout;
+    start_time = now();
+    terminating = false;
+    exit_reason = ExitReason::Exited;
+    key_monitor.resetInactivity();
+    key_monitor.takeExitRequest();
+    wake();
+    return true;
+}
+
+#else
+GameSupervisor::GameSupervisor(UnfocusedKeyMonitor& key_monitor)
+: key_monitor(key_monitor)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+
+    key_monitor.setExitCallback([this]() { wake(); });
+    thread = std::thread(&GameSupervisor::run, this);
+}
+
+GameSupervisor::~GameSupervisor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        if (pid > 0)
+        {
+            kill(-pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+            pid = 0;
+        }
+    }
+    wake();
+    thread.join();
+    if (pid_fd >= 0)
+        close(pid_fd);
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+bool GameSupervisor::launch(sp::string executable, sp::string working_directory, float inactivity_timeout)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pid > 0)
+        return false;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for(int cpu : cpu_affinity)
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &cpu_set);
+
+    pid_t child = fork();
+    if (child < 0)
+    {
+        LOG(Error, "Failed to start", executable);
+        return false;
+    }
+    if (child == 0)
+    {
+        //Own process group, so stopping the game also stops anything it started.
+        setpgid(0, 0);
+        if (!cpu_affinity.empty())
+            sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+        if (chdir(working_directory.c_str()) == 0)
+            execl(executable.c_str(), executable.c_str(), nullptr);
+        _exit(127);
+    }
+    setpgid(child, child);
+
+    pid = child;
+    this->inactivity_timeout = inactivity_timeout;
+    start_time = now();
+    terminating = false;
+    exit_reason = ExitReason::Exited;
+    key_monitor.resetInactivity();
+    key_monitor.takeExitRequest();
+
+    //A pidfd becomes readable when the process exits. Without one (kernels before 5.3) the event loop checks the process on every timeout.
+#ifdef SYS_pidfd_open
+    pid_fd = syscall(SYS_pidfd_open, pid, 0);
+    if (pid_fd >= 0)
+    {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = pid_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pid_fd, &event);
+    }
+#endif
+    wake();
+    return true;
+}
+
+#endif//__WIN32__
+
+void GameSupervisor::setCpuAffinity(std::vector<int> cpus)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    cpu_affinity = cpus;
+}
+
+bool GameSupervisor::isRunning()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pid > 0;
+}
+
+bool GameSupervisor::pollFinished(Result& result)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (finished.empty())
+        return false;
+    result = finished.front();
+    finished.pop_front();
+    return true;
+}
+
+#ifdef __WIN32__
+void GameSupervisor::wake()
+{
+    wake_condition.notify_all();
+}
+
+void GameSupervisor::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!stopping)
+    {
+        int timeout = getTimeout();
+        if (timeout < 0)
+            wake_condition.wait(lock);
+        else
+            wake_condition.wait_for(lock, std::chrono::milliseconds(timeout));
+        if (pid > 0)
+            checkProcess();
+    }
+}
+
+#else
+void GameSupervisor::wake()
+{
+    uint64_t value = 1;
+    if (write(wake_fd, &value, sizeof(value)) < 0)
+        LOG(Warning, "Failed to wake game supervisor");
+}
+
+void GameSupervisor::run()
+{
+    while(true)
+    {
+        int timeout;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return;
+            timeout = getTimeout();
+        }
+        epoll_event events[4];
+        int count = epoll_wait(epoll_fd, events, 4, timeout);
+        for(int n=0; n<count; n++)
+        {
+            if (events[n].data.fd == wake_fd)
+            {
+                uint64_t value;
+                if (read(wake_fd, &value, sizeof(value)) < 0)
+                    continue;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pid > 0)
+            checkProcess();
+    }
+}
+
+#endif//__WIN32__
+
+int GameSupervisor::getTimeout()
+{
+    if (pid <= 0)
+        return -1;
+    double timeout;
+    if (terminating)
+        timeout = kill_time - now();
+    else
+        timeout = inactivity_timeout - key_monitor.getInactivityTime();
+    //Without a pidfd we do not get an event when the game exits, so we need to poll for it.
+    if (pid_fd < 0)
+        timeout = std::min(timeout, 0.1);
+    return std::max(0, int(std::ceil(timeout * 1000.0)));
+}
+
+#ifdef __WIN32__
+void GameSupervisor::terminate(ExitReason reason)
+{
+    LOG(Info, "Stopping game");
+    terminating = true;
+    exit_reason = reason;
+    kill_time = now() + kill_grace_time;
+    process->kill(false);
+}
+
+void GameSupervisor::checkProcess()
+{
+    if (!process->isRunning())
+    {
+        Result result;
+        result.reason = exit_reason;
+        result.exit_status = process->wait();
+        result.run_time = now() - start_time;
+        finished.push_back(result);
+        LOG(Info, "Game stopped, status:", result.exit_status);
+        process = nullptr;
+        pid = 0;
+        return;
+    }
+
+    if (terminating)
+    {
+        if (now() >= kill_time)
+        {
+            LOG(Warning, "Game did not stop in time, killing it");
+            process->kill(true);
+            kill_time = now() + kill_grace_time;
+        }
+    }
+    else if (key_monitor.takeExitRequest())
+    {
+        terminate(ExitReason::ExitKey);
+    }
+    else if (key_monitor.getInactivityTime() >= inactivity_timeout)
+    {
+        terminate(ExitReason::Inactivity);
+    }
+}
+#else
+void GameSupervisor::terminate(ExitReason reason)
+{
+    LOG(Info, "Stopping game, pid:", pid);
+    terminating = true;
+    exit_reason = reason;
+    kill_time = now() + kill_grace_time;
+    kill(-pid, SIGTERM);
+}
+
+void GameSupervisor::checkProcess()
+{
+    int status = 0;
+    if (waitpid(pid, &status, WNOHANG) == pid)
+    {
+        Result result;
+        result.reason = exit_reason;
+        result.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        result.run_time = now() - start_time;
+        finished.push_back(result);
+        LOG(Info, "Game stopped, pid:", pid, "status:", result.exit_status);
+
+        if (pid_fd >= 0)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pid_fd, nullptr);
+            close(pid_fd);
+            pid_fd = -1;
+        }
+        pid = 0;
+        return;
+    }
+
+    if (terminating)
+    {
+        if (now() >= kill_time)
+        {
+            LOG(Warning, "Game did not stop in time, killing pid:", pid);
+            kill(-pid, SIGKILL);
+            kill_time = now() + kill_grace_time;
+        }
+    }
+    else if (key_monitor.takeExitRequest())
+    {
+        terminate(ExitReason::ExitKey);
+    }
+    else if (key_monitor.getInactivityTime() >= inactivity_timeout)
+    {
+        terminate(ExitReason::Inactivity);
+    }
+}
+#endif//__WIN32__
@@ -0,0 +1,79 @@
+#ifndef GAME_SUPERVISOR_H
+#define GAME_SUPERVISOR_H
+
+#include <sp2/string.h>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <sys/types.h>
+#ifdef __WIN32__
+#include <sp2/io/subprocess.h>
+#include <condition_variable>
+#include <memory>
+#endif//__WIN32__
+
+class UnfocusedKeyMonitor;
+
+//Starts games and watches them from a background event loop, so the launcher keeps running while a game is played.
+//The game is stopped when the exit key is pressed or nothing was pressed for too long, first with SIGTERM, and with SIGKILL if it does not stop in time.
+class GameSupervisor
+{
+public:
+    enum class ExitReason
+    {
+        Exited,
+        ExitKey,
+        Inactivity
+    };
+    class Result
+    {
+    public:
+        ExitReason reason;
+        int exit_status;
+        float run_time;
+    };
+
+    GameSupervisor(UnfocusedKeyMonitor& key_monitor);
+    ~GameSupervisor();
+
+    //Start a game, only a single game can run at a time.
+    bool launch(sp::string executable, sp::string working_directory, float inactivity_timeout);
+    //Pin games to these cores, an empty list lets the game use all cores.
+    void setCpuAffinity(std::vector<int> cpus);
+    bool isRunning();
+    //Called from the main thread. Returns true once for every game that stopped.
+    bool pollFinished(Result& result);
+private:
+    void run();
+    void wake();
+    int getTimeout();
+    void terminate(ExitReason reason);
+    void checkProcess();
+
+    static constexpr float kill_grace_time = 5.0;
+
+    UnfocusedKeyMonitor& key_monitor;
+    std::mutex mutex;
+    std::thread thread;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    bool stopping = false;
+
+    pid_t pid = 0;
+    int pid_fd = -1;
+    float inactivity_timeout = 0;
+    std::vector<int> cpu_affinity;
+    double start_time = 0;
+    double kill_time = 0;
+    bool terminating = false;
+    ExitReason exit_reason = ExitReason::Exited;
+    std::deque<Result> finished;
+#ifdef __WIN32__
+    //Without process groups and pidfds the game is started as a subprocess, and pid only marks that a game runs.
+    std::unique_ptr<sp::io::Subprocess> process;
+    std::condition_variable wake_condition;
+#endif//__WIN32__
+};
+
+#endif//GAME_SUPERVISOR_H
@@ -0,0 +1,103 @@
+#include "gitBackend.h"
+#include "capturedProcess.h"
+#include "fileUtil.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/filesystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GIT "git"
+
+
+GitBackend::~GitBackend()
+{
+}
+
+sp::string GitBackend::getHeadCommit(sp::string target)
+{
+    sp::string git_dir = target + "/.git";
+    sp::string head = readFileLine(git_dir + "/HEAD");
+    if (!head.startswith("ref: "))
+        return head;
+
+    sp::string ref = head.substr(5).strip();
+    sp::string commit = readFileLine(git_dir + "/" + ref);
+    if (commit != "")
+        return commit;
+
+    //The ref can also be stored in the packed-refs file, as "<commit> <ref>" lines.
+    FILE* f = fopen((git_dir + "/packed-refs").c_str(), "rt");
+    if (!f)
+        return "";
+    char buffer[512];
+    while(fgets(buffer, sizeof(buffer), f))
+    {
+        std::vector<sp::string> parts = sp::string(buffer).strip().split(" ");
+        if (parts.size() == 2 && parts[1] == ref)
+        {
+            commit = parts[0];
+            break;
+        }
+    }
+    fclose(f);
+    return commit;
+}
+
+std::unique_ptr<GitBackend> GitBackend::create()
+{
+    sp::string name;
+    const char* env = getenv("ARCADE_GIT_BACKEND");
+    if (env)
+        name = env;
+#ifdef ARCADE_LIBGIT2
+    if (name != "subprocess")
+    {
+        LOG(Info, "Using libgit2 git backend");
+        return std::unique_ptr<GitBackend>(new LibGit2Backend());
+    }
+#else
+    if (name == "libgit2")
+        LOG(Warning, "libgit2 git backend not compiled in, falling back to the git executable");
+#endif
+    LOG(Info, "Using subprocess git backend");
+    return std::unique_ptr<GitBackend>(new SubprocessGitBackend());
+}
+
+bool SubprocessGitBackend::update(sp::string repository, sp::string target, BuildLog& log)
+{
+    if (!sp::io::isDirectory(target))
+    {
+        LOG(Info, target, ": Running git clone");
+        CapturedProcess git_process({GIT, "clone", "--progress", "--depth", "1", "--single-branch", repository, target});
+        if (git_process.run(log) != 0)
+        {
+            LOG(Error, target, ": Failed to clone repository", repository);
+            return false;
+        }
+    }
+    else
+    {
+        LOG(Info, target, ": Running git pull");
+        CapturedProcess git_process({GIT, "pull", "--progress", "--ff-only"}, target);
+        if (git_process.run(log) != 0)
+        {
+            LOG(Error, target, ": Failed to pull repository", repository);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SubprocessGitBackend::reset(sp::string target, sp::string commit, BuildLog& log)
+{
+    LOG(Info, target, ": Running git reset to", commit);
+    CapturedProcess git_process({GIT, "reset", "--hard", commit}, target);
+    if (git_process.run(log) != 0)
+    {
+        LOG(Error, target, ": Failed to reset to", commit);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef GIT_BACKEND_H
+#define GIT_BACKEND_H
+
+#include <sp2/string.h>
+#include <memory>
+
+class BuildLog;
+
+//Keeps local checkouts of game and depends repositories up to date.
+//Repository urls can also be local paths, so a bare repository can stand in for GitHub.
+class GitBackend
+{
+public:
+    virtual ~GitBackend();
+
+    //Clone the repository into target when it does not exist yet, else bring the checked out branch up to date with the remote.
+    //Called from multiple build workers at the same time, for different targets. Progress and output go to the log.
+    virtual bool update(sp::string repository, sp::string target, BuildLog& log) = 0;
+    //Put the checkout back at a commit it had before, files and branch, after an update that could not be built.
+    virtual bool reset(sp::string target, sp::string commit, BuildLog& log) = 0;
+    //Returns the commit hash HEAD of the checkout points to, or an empty string if it cannot be found.
+    virtual sp::string getHeadCommit(sp::string target);
+
+    //Create the backend selected with the ARCADE_GIT_BACKEND environment variable ("libgit2" or "subprocess").
+    //Defaults to libgit2 when it is compiled in.
+    static std::unique_ptr<GitBackend> create();
+};
+
+//Runs the git executable for every clone and pull.
+class SubprocessGitBackend : public GitBackend
+{
+public:
+    virtual bool update(sp::string repository, sp::string target, BuildLog& log) override;
+    virtual bool reset(sp::string target, sp::string commit, BuildLog& log) override;
+};
+
+#ifdef ARCADE_LIBGIT2
+//Updates repositories in-process. Only fetches when the remote branch moved, and only fetches that single branch.
+class LibGit2Backend : public GitBackend
+{
+public:
+    LibGit2Backend();
+    virtual ~LibGit2Backend();
+
+    virtual bool update(sp::string repository, sp::string target, BuildLog& log) override;
+    virtual bool reset(sp::string target, sp::string commit, BuildLog& log) override;
+    virtual sp::string getHeadCommit(sp::string target) override;
+private:
+    bool clone(sp::string repository, sp::string target, BuildLog& log);
+    bool pull(sp::string target, BuildLog& log);
+    bool resetTo(sp::string target, sp::string commit, BuildLog& log);
+};
+#endif//ARCADE_LIBGIT2
+
+#endif//GIT_BACKEND_H
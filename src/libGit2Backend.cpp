@@ -0,0 +1,288 @@
+#ifdef ARCADE_LIBGIT2
+#include "gitBackend.h"
+#include "buildLog.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/filesystem.h>
+
+#include <git2.h>
+#ifndef __WIN32__
+#include <sys/resource.h>
+#endif//__WIN32__
+#include <chrono>
+
+//Shallow fetches are only supported since libgit2 1.7
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 7)
+#define LIBGIT2_HAS_SHALLOW 1
+#endif
+
+template<typename T> using GitPtr = std::unique_ptr<T, void(*)(T*)>;
+
+
+//The reason goes into the build log as well, so it is shown with the game and not only in the launcher log.
+static void logGitError(BuildLog& log, sp::string target, sp::string action)
+{
+    const git_error* error = git_error_last();
+    sp::string message = error ? error->message : "unknown error";
+    LOG(Error, target, ": Failed to", action, ":", message);
+    log.addLine("Failed to " + action + ": " + message);
+}
+
+#ifdef LIBGIT2_HAS_SHALLOW
+//The local transport does not support shallow fetches, so local paths and file:// urls are always fetched in full.
+static bool isLocalRepository(sp::string url)
+{
+    if (url.startswith("file://"))
+        return true;
+    if (url.find("://") != std::string::npos)
+        return false;
+    //scp like "user@host:path" urls go over ssh. A single letter before the colon is a Windows drive.
+    size_t colon = url.find(':');
+    size_t slash = url.find('/');
+    if (colon != std::string::npos && colon > 1 && (slash == std::string::npos || colon < slash))
+        return false;
+    return true;
+}
+#endif
+
+static int transferProgress(const git_indexer_progress* stats, void* payload)
+{
+    if (stats->total_objects > 0)
+        static_cast<BuildLog*>(payload)->setProgress(stats->received_objects * 100 / stats->total_objects);
+    return 0;
+}
+
+static float getThreadCpuTime()
+{
+#ifdef RUSAGE_THREAD
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0)
+        return 0.0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+#else
+    //RUSAGE_THREAD is Linux only, elsewhere only the wall time is recorded.
+    return 0.0;
+#endif//RUSAGE_THREAD
+}
+
+LibGit2Backend::LibGit2Backend()
+{
+    git_libgit2_init();
+}
+
+LibGit2Backend::~LibGit2Backend()
+{
+    git_libgit2_shutdown();
+}
+
+bool LibGit2Backend::update(sp::string repository, sp::string target, BuildLog& log)
+{
+    //Everything runs on this thread, so the thread cpu time is the time spend in libgit2.
+    auto start = std::chrono::steady_clock::now();
+    float start_cpu_time = getThreadCpuTime();
+    bool result;
+    if (!sp::io::isDirectory(target))
+    {
+        log.beginCommand("libgit2 clone " + repository);
+        result = clone(repository, target, log);
+    }
+    else
+    {
+        log.beginCommand("libgit2 pull " + target);
+        result = pull(target, log);
+    }
+    log.endCommand(std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count(), getThreadCpuTime() - start_cpu_time, result ? 0 : 1);
+    return result;
+}
+
+bool LibGit2Backend::reset(sp::string target, sp::string commit, BuildLog& log)
+{
+    log.beginCommand("libgit2 reset " + commit);
+    auto start = std::chrono::steady_clock::now();
+    float start_cpu_time = getThreadCpuTime();
+    bool result = resetTo(target, commit, log);
+    log.endCommand(std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count(), getThreadCpuTime() - start_cpu_time, result ? 0 : 1);
+    return result;
+}
+
+bool LibGit2Backend::resetTo(sp::string target, sp::string commit, BuildLog& log)
+{
+    LOG(Info, target, ": Resetting to", commit);
+    git_repository* repository_ptr = nullptr;
+    if (git_repository_open(&repository_ptr, target.c_str()) != 0)
+    {
+        logGitError(log, target, "open repository");
+        return false;
+    }
+    GitPtr<git_repository> repository(repository_ptr, git_repository_free);
+
+    git_oid oid;
+    git_object* commit_ptr = nullptr;
+    if (git_oid_fromstr(&oid, commit.c_str()) != 0 || git_object_lookup(&commit_ptr, repository.get(), &oid, GIT_OBJECT_COMMIT) != 0)
+    {
+        logGitError(log, target, "find commit " + commit);
+        return false;
+    }
+    GitPtr<git_object> commit_object(commit_ptr, git_object_free);
+    //A hard reset moves the branch back as well, so the next update sees the remote as changed and builds it again.
+    if (git_reset(repository.get(), commit_object.get(), GIT_RESET_HARD, nullptr) != 0)
+    {
+        logGitError(log, target, "reset to " + commit);
+        return false;
+    }
+    return true;
+}
+
+sp::string LibGit2Backend::getHeadCommit(sp::string target)
+{
+    git_repository* repository_ptr = nullptr;
+    if (git_repository_open(&repository_ptr, target.c_str()) != 0)
+        return "";
+    GitPtr<git_repository> repository(repository_ptr, git_repository_free);
+
+    git_oid oid;
+    if (git_reference_name_to_id(&oid, repository.get(), "HEAD") != 0)
+        return "";
+    char buffer[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(buffer, sizeof(buffer), &oid);
+    return buffer;
+}
+
+bool LibGit2Backend::clone(sp::string repository, sp::string target, BuildLog& log)
+{
+    LOG(Info, target, ": Cloning", repository);
+    git_clone_options options = GIT_CLONE_OPTIONS_INIT;
+    options.fetch_opts.callbacks.transfer_progress = transferProgress;
+    options.fetch_opts.callbacks.payload = &log;
+#ifdef LIBGIT2_HAS_SHALLOW
+    if (!isLocalRepository(repository))
+        options.fetch_opts.depth = 1;
+#endif
+    git_repository* repository_ptr = nullptr;
+    if (git_clone(&repository_ptr, repository.c_str(), target.c_str(), &options) != 0)
+    {
+        logGitError(log, target, "clone " + repository);
+        return false;
+    }
+    git_repository_free(repository_ptr);
+    return true;
+}
+
+bool LibGit2Backend::pull(sp::string target, BuildLog& log)
+{
+    git_repository* repository_ptr = nullptr;
+    if (git_repository_open(&repository_ptr, target.c_str()) != 0)
+    {
+        logGitError(log, target, "open repository");
+        return false;
+    }
+    GitPtr<git_repository> repository(repository_ptr, git_repository_free);
+
+    git_reference* head_ptr = nullptr;
+    if (git_repository_head(&head_ptr, repository.get()) != 0)
+    {
+        logGitError(log, target, "find HEAD");
+        return false;
+    }
+    GitPtr<git_reference> head(head_ptr, git_reference_free);
+    if (!git_reference_is_branch(head.get()))
+    {
+        LOG(Error, target, ": HEAD is not a branch, cannot update");
+        log.addLine("HEAD is not a branch, cannot update");
+        return false;
+    }
+    sp::string branch_ref = git_reference_name(head.get());
+    sp::string branch = git_reference_shorthand(head.get());
+
+    git_remote* remote_ptr = nullptr;
+    if (git_remote_lookup(&remote_ptr, repository.get(), "origin") != 0)
+    {
+        logGitError(log, target, "find remote origin");
+        return false;
+    }
+    GitPtr<git_remote> remote(remote_ptr, git_remote_free);
+
+    //Only list the refs of the remote first. This is a single round trip, and most of the time nothing changed.
+    git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+    if (git_remote_connect(remote.get(), GIT_DIRECTION_FETCH, &callbacks, nullptr, nullptr) != 0)
+    {
+        logGitError(log, target, "connect to remote");
+        return false;
+    }
+    const git_remote_head** remote_heads = nullptr;
+    size_t remote_head_count = 0;
+    if (git_remote_ls(&remote_heads, &remote_head_count, remote.get()) != 0)
+    {
+        logGitError(log, target, "list remote refs");
+        return false;
+    }
+    git_oid remote_oid;
+    bool found = false;
+    for(size_t n=0; n<remote_head_count; n++)
+    {
+        if (branch_ref == remote_heads[n]->name)
+        {
+            git_oid_cpy(&remote_oid, &remote_heads[n]->oid);
+            found = true;
+        }
+    }
+    git_remote_disconnect(remote.get());
+    if (!found)
+    {
+        LOG(Error, target, ": Remote has no branch", branch);
+        log.addLine("Remote has no branch " + branch);
+        return false;
+    }
+    if (git_oid_equal(&remote_oid, git_reference_target(head.get())))
+    {
+        LOG(Info, target, ": Up to date");
+        log.addLine("Already up to date.");
+        return true;
+    }
+
+    LOG(Info, target, ": Fetching", branch);
+    log.addLine("Fetching " + branch);
+    sp::string refspec = "+" + branch_ref + ":refs/remotes/origin/" + branch;
+    char* refspec_ptr = &refspec[0];
+    git_strarray refspecs = {&refspec_ptr, 1};
+    git_fetch_options fetch_options = GIT_FETCH_OPTIONS_INIT;
+    fetch_options.callbacks.transfer_progress = transferProgress;
+    fetch_options.callbacks.payload = &log;
+#ifdef LIBGIT2_HAS_SHALLOW
+    if (!isLocalRepository(git_remote_url(remote.get())))
+        fetch_options.depth = 1;
+#endif
+    if (git_remote_fetch(remote.get(), &refspecs, &fetch_options, "arcade: fetch") != 0)
+    {
+        logGitError(log, target, "fetch " + branch);
+        return false;
+    }
+
+    git_object* commit_ptr = nullptr;
+    if (git_object_lookup(&commit_ptr, repository.get(), &remote_oid, GIT_OBJECT_COMMIT) != 0)
+    {
+        logGitError(log, target, "find fetched commit");
+        return false;
+    }
+    GitPtr<git_object> commit(commit_ptr, git_object_free);
+
+    //Safe checkout refuses to overwrite local modifications, in which case we leave the checkout as it was.
+    git_checkout_options checkout_options = GIT_CHECKOUT_OPTIONS_INIT;
+    checkout_options.checkout_strategy = GIT_CHECKOUT_SAFE;
+    if (git_checkout_tree(repository.get(), commit.get(), &checkout_options) != 0)
+    {
+        logGitError(log, target, "checkout");
+        log.addLine("Checkout failed, local changes?");
+        return false;
+    }
+    git_reference* new_head_ptr = nullptr;
+    if (git_reference_set_target(&new_head_ptr, head.get(), &remote_oid, "arcade: update to remote") != 0)
+    {
+        logGitError(log, target, "update branch");
+        return false;
+    }
+    git_reference_free(new_head_ptr);
+    return true;
+}
+
+#endif//ARCADE_LIBGIT2
@@ -3,9 +3,7 @@
 #include <sp2/logging.h>
 #include <sp2/random.h>
 #include <sp2/io/keybinding.h>
-#include <sp2/io/subprocess.h>
 #include <sp2/io/directoryResourceProvider.h>
-#include <sp2/io/keyValueTreeLoader.h>
 #include <sp2/graphics/gui/scene.h>
 #include <sp2/graphics/gui/theme.h>
 #include <sp2/graphics/gui/loader.h>
@@ -26,8 +24,20 @@
 #include "unfocusedKeyInfo.h"
 #include "performanceTest.h"
 #include "cameraCaptureTexture.h"
-
-#define GIT "git"
+#include "buildScheduler.h"
+#include "buildCache.h"
+#include "gitBackend.h"
+#include "gameSupervisor.h"
+#include "previewAtlas.h"
+#include "thumbnailCache.h"
+#include "gameStateStore.h"
+#include "buildLog.h"
+#include "capturedProcess.h"
+#include "compilerCache.h"
+#include "resourceGovernor.h"
+#include "catalog.h"
+#include "trace.h"
+#include "metrics.h"
 
 sp::P<sp::Window> window;
 sp::P<sp::Scene> scene;
@@ -48,126 +58,435 @@ sp::io::Keybinding camera_key("CAMERA", "2");
 CameraCaptureTexture* camera_capture_texture;
 sp::P<sp::Node> camera_display_node;
 
+BuildScheduler build_scheduler;
+UnfocusedKeyMonitor key_monitor;
+std::unique_ptr<GameSupervisor> game_supervisor;
+std::unique_ptr<GitBackend> git_backend;
+std::unique_ptr<ResourceGovernor> resource_governor;
+
+PreviewAtlas preview_atlas;
+PreviewAtlas::Entry loading_preview;
+PreviewAtlas::Entry error_preview;
+ThumbnailCache thumbnail_cache("_thumbnails");
+GameStateStore game_state_store("arcade_state.txt");
+CompilerCache compiler_cache("_ccache");
+Metrics metrics;
+
+//Start of the launcher, to report how long it takes until the first game can be played.
+std::chrono::steady_clock::time_point boot_time = std::chrono::steady_clock::now();
+std::once_flag first_playable_flag;
+
+//Can be called from any thread, only the first call counts.
+void markPlayable()
+{
+    std::call_once(first_playable_flag, []()
+    {
+        metrics.set("arcade_first_playable_seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - boot_time).count());
+    });
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//All builds share one budget of cores. The worker pool is sized from it, and every make or ninja command gets its share as -j,
+//instead of each parallel build starting as many compilers as its build command asks for.
+int build_worker_count = 1;
+int build_jobs_per_command = 1;
+
+void setupBuildBudget()
+{
+    int cores = std::max(1, int(std::thread::hardware_concurrency()));
+    build_worker_count = std::max(1, std::min(4, cores / 2));
+    build_jobs_per_command = std::max(1, cores / build_worker_count);
+    LOG(Info, "Building with", build_worker_count, "workers of", build_jobs_per_command, "jobs each");
+}
+
+static std::vector<sp::string> applyBuildBudget(std::vector<sp::string> command)
+{
+    if (command.empty() || (command[0] != "make" && command[0] != "ninja"))
+        return command;
+    auto isCount = [](const sp::string& s)
+    {
+        for(char c : s)
+            if (c < '0' || c > '9')
+                return false;
+        return !s.empty();
+    };
+    std::vector<sp::string> result{command[0], "-j", sp::string(build_jobs_per_command)};
+    for(size_t n=1; n<command.size(); n++)
+    {
+        if (command[n] == "-j" || command[n] == "--jobs")
+        {
+            if (n + 1 < command.size() && isCount(command[n + 1]))
+                n++;
+            continue;
+        }
+        if (command[n].startswith("-j") || command[n].startswith("--jobs="))
+            continue;
+        result.push_back(command[n]);
+    }
+    return result;
+}
+
+//Time anything on screen last changed, when nothing changes for a while the launcher renders at a lower frame rate.
+std::chrono::steady_clock::time_point last_activity_time = std::chrono::steady_clock::now();
+
+//Set while the IdleLimiter stretches frames on purpose, those frames say nothing about how fast the launcher renders.
+bool idle_throttling = false;
+
+//Only called from the main thread.
+void markActivity()
+{
+    last_activity_time = std::chrono::steady_clock::now();
+}
+
 
-class GameNode : public sp::Node
+//A game from the catalog. This is not a scene node, the carousel only draws the games that are in view.
+class Game
 {
 public:
-    GameNode(sp::P<sp::Node> parent, sp::string name)
-    : sp::Node(parent), name(name)
+    Game(sp::string name)
+    : name(name)
     {
-        render_data.type = sp::RenderData::Type::None;
-        render_data.shader = sp::Shader::get("internal:basic.shader");
-        render_data.mesh = sp::MeshData::createDoubleSidedQuad(sp::Vector2f(4.0/3.0, 1));
-        render_data.texture = sp::texture_manager.get("loading.png");
+        updatePreview();
     }
-    
-    virtual void onUpdate(float delta) override
+
+    //Show the preview from the last boot while the game is updated, if it did not change since.
+    //Only done once the game comes into view, so a large catalog does not fill the atlas at boot.
+    void loadCachedPreview()
     {
-        if (prev_update_state == state)
+        if (cached_preview_loaded)
+            return;
+        cached_preview_loaded = true;
+        TraceSpan span("cached preview load", name);
+        sp::Image image;
+        if (!thumbnail_cache.load(name, name + "/preview.png", image))
             return;
+        preview = preview_atlas.add(name + "/preview.png", std::move(image));
+        {
+            std::lock_guard<std::mutex> lock(preview_mutex);
+            if (!loaded_preview.isValid())
+                loaded_preview = preview;
+        }
+        preview_changed = true;
+    }
+    
+    //Called every frame while the game is in view. Returns true when what the game shows changed.
+    bool update()
+    {
+        if (running)
+        {
+            GameSupervisor::Result result;
+            if (game_supervisor->pollFinished(result))
+            {
+                LOG(Info, name, ": Stopped after", result.run_time, "seconds");
+                Trace::addSpan("game running", name, launch_end, Trace::Clock::now());
+                metrics.observe("arcade_game_session_seconds", result.run_time, name);
+                if (result.reason == GameSupervisor::ExitReason::Inactivity)
+                    metrics.increment("arcade_game_inactivity_kills_total", name);
+                running = false;
+                {
+                    TraceSpan span("return to launcher", name);
+                    resource_governor->setGameRunning(false);
+#ifndef DEBUG
+                    window->setFullScreen(true);
+#endif
+                }
+                //The launcher can run for days, so write the trace whenever a game returns instead of only at exit.
+                Trace::write();
+            }
+            else
+            {
+                //The launcher is in the background, do not compete with the game for CPU and GPU time.
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+        if (prev_update_state == state && !preview_changed)
+            return false;
         prev_update_state = state;
+        preview_changed = false;
+        updatePreview();
+        markActivity();
+        return true;
+    }
+
+    void updatePreview()
+    {
         switch(state)
         {
         case State::Waiting:
         case State::Loading:
-            render_data.texture = sp::texture_manager.get("loading.png");
+            if (preview.isValid())
+            {
+                //The preview from the thumbnail cache is shown darker while the game is not playable yet.
+                showPreview(preview, name + "/preview.png");
+                display_color = sp::Color(0.4, 0.4, 0.4);
+            }
+            else
+            {
+                showPreview(loading_preview, "loading.png");
+            }
             break;
         case State::Ready:
-            render_data.texture = sp::texture_manager.get(name + "/preview.png");
+            {
+                std::lock_guard<std::mutex> lock(preview_mutex);
+                preview = loaded_preview;
+            }
+            showPreview(preview, name + "/preview.png");
+            display_color = sp::Color(1, 1, 1);
             break;
         case State::Error:
-            render_data.texture = sp::texture_manager.get("error.png");
+            showPreview(error_preview, "error.png");
+            display_color = sp::Color(1, 1, 1);
             break;
         }
     }
+
+    //Show an image from the preview atlas, or the texture itself if it could not be put in the atlas.
+    void showPreview(const PreviewAtlas::Entry& entry, sp::string fallback_texture)
+    {
+        if (entry.isValid())
+        {
+            display = entry;
+            return;
+        }
+        display = PreviewAtlas::Entry();
+        display.texture = sp::texture_manager.get(fallback_texture);
+        display.uv0 = sp::Vector2f(0, 1);
+        display.uv1 = sp::Vector2f(1, 0);
+    }
     
     void run()
     {
         if (state != State::Ready)
             return;
+        //The checkout the game runs from is being changed, so the game would see a half updated tree.
+        if (updating)
+        {
+            LOG(Info, name, ": Not started while it is being updated");
+            return;
+        }
         LOG(Info, "Running:", exec, "@", name);
+        TraceSpan span("launch", name);
+        if (!game_supervisor->launch(getReadyBinary(), name, inactivity_timeout))
+            return;
+        running = true;
+        metrics.increment("arcade_game_launches_total", name);
+        resource_governor->setGameRunning(true);
 #ifndef DEBUG
         window->setFullScreen(false);
 #endif
+        launch_end = Trace::Clock::now();
+    }
+
+    //Make the game playable right away with the build that worked last time, if it is still there.
+    //Called from the main thread before any load job is scheduled.
+    void restoreState()
+    {
+        GameStateStore::Record record;
+        if (!game_state_store.get(name, record) || record.binary != getReadyBinary())
+            return;
+        //An update that was interrupted can have left the checkout at other sources than the build was made from.
+        if (git_backend->getHeadCommit(name) != record.commit)
+            return;
+        FILE* f = fopen((name + "/" + record.binary).c_str(), "rb");
+        if (!f)
+            return;
+        fclose(f);
+        LOG(Info, name, ": Restored last good build of", record.commit);
+        state = State::Ready;
+        markPlayable();
+    }
 
-        sp::io::Subprocess process({"_build/" + exec}, name);
-        float timeout = inactivity_timeout;
-        while(process.isRunning())
+    void setEntry(const CatalogEntry& entry)
+    {
+        exec = entry.exec;
+        git = entry.git;
+        depends_path = entry.depends_path;
+        depends_repo = entry.depends_repo;
+        build_commands = entry.build_commands;
+    }
+
+    CatalogEntry getEntry()
+    {
+        CatalogEntry entry;
+        entry.name = name;
+        entry.exec = exec;
+        entry.git = git;
+        entry.depends_path = depends_path;
+        entry.depends_repo = depends_repo;
+        entry.build_commands = build_commands;
+        return entry;
+    }
+
+    //Text for the INFO label: the repository, with what is being built or why the build failed.
+    sp::string getInfo()
+    {
+        if (state == State::Loading)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            if (isAnyKeyPressed())
-                timeout = inactivity_timeout;
-            else
-                timeout -= 0.1;
-            if (timeout <= 0 || isExitKeyPressed())
-            {
-                timeout = inactivity_timeout;
-                process.kill(true);
-            }
+            sp::string status = build_log.getStatus();
+            if (status != "")
+                return git + "\n" + status;
         }
-#ifndef DEBUG
-        window->setFullScreen(true);
-#endif
+        if (state == State::Error)
+        {
+            std::vector<sp::string> lines = build_log.getLines();
+            sp::string result = git;
+            for(unsigned int n=std::max(0, int(lines.size()) - 3); n<lines.size(); n++)
+                result += "\n" + lines[n];
+            return result;
+        }
+        return git;
     }
 
-    void doASyncLoad()
+    bool doASyncLoad()
     {
-        state = State::Loading;
+        //A game that already has a good build stays playable while it is updated.
+        if (state != State::Ready)
+            state = State::Loading;
+        updating = true;
         LOG(Info, name, ": Loading");
+        build_log.clear();
         if (exec == "" || git == "")
         {
             LOG(Error, name, ": No exec or git info");
-            state = State::Error;
-            return;
+            return setFailed();
+        }
+        {
+            TraceSpan span("git update", name);
+            auto git_start = std::chrono::steady_clock::now();
+            bool success = git_backend->update(git, name, build_log);
+            metrics.observe("arcade_git_seconds", secondsSince(git_start), name);
+            if (!success)
+            {
+                metrics.increment("arcade_git_failures_total", name);
+                return setFailed();
+            }
         }
-        if (depends_repo != "")
-            if (!updateGit(depends_repo, depends_path))
-                return;
-        if (!updateGit(git, name))
-            return;
         sp::string build_path = name + "/_build";
         sp::io::makeDirectory(build_path);
+        BuildCache build_cache(build_path);
+        sp::string commit = git_backend->getHeadCommit(name);
+        sp::string build_key = BuildCache::makeKey(commit, depends_path != "" ? git_backend->getHeadCommit(depends_path) : "", build_commands);
+        if (build_cache.isValid(build_key, exec))
+        {
+            LOG(Info, name, ": Build is up to date");
+            if (!install(commit, build_key))
+                return setFailed();
+            setReady();
+            return true;
+        }
+        //Forget the old key first, so a failed or interrupted build is never seen as up to date.
+        build_cache.invalidate();
+        auto build_start = std::chrono::steady_clock::now();
         for(sp::string command : build_commands)
         {
             LOG(Info, name, ": Running build command:", command, "at", build_path);
-            sp::io::Subprocess build_process(command.strip().split(" "), build_path);
-            if (build_process.wait() != 0)
+            TraceSpan span("build command", name + ": " + command);
+            CapturedProcess build_process(compiler_cache.prepareCommand(applyBuildBudget(command.strip().split(" "))), build_path);
+            compiler_cache.setEnvironment(build_process);
+            if (build_process.run(build_log) != 0)
             {
                 LOG(Error, name, ": Failed to build:", command);
-                state = State::Error;
-                return;
+                for(auto& line : build_log.getLines())
+                    LOG(Error, name, ":", line);
+                metrics.increment("arcade_build_failures_total", name);
+                return setFailed();
             }
         }
+        metrics.observe("arcade_build_seconds", secondsSince(build_start), name);
+        build_cache.store(build_key);
+        if (!install(commit, build_key))
+            return setFailed();
         
-        state = State::Ready;
-        LOG(Info, name, ": Ready");
+        setReady();
+        return true;
     }
-    
-    bool updateGit(sp::string repo, sp::string target)
+
+    //Swap the new build in, and remember it as the last good build.
+    bool install(sp::string commit, sp::string build_key)
     {
-        if (!sp::io::isDirectory(target))
+        GameStateStore::Record record;
+        if (game_state_store.get(name, record) && record.build_key == build_key && record.binary == getReadyBinary())
+            return true;
+        sp::io::makeDirectory(name + "/_ready");
+        if (!GameStateStore::installBinary(name + "/_build/" + exec, name + "/" + getReadyBinary()))
+            return false;
+        record.commit = commit;
+        record.build_key = build_key;
+        record.binary = getReadyBinary();
+        game_state_store.set(name, record);
+        return true;
+    }
+
+    //Games are run from _ready, a new build is only copied there when it fully succeeded.
+    sp::string getReadyBinary()
+    {
+        return "_ready/" + exec;
+    }
+
+    bool setFailed()
+    {
+        if (state == State::Ready)
         {
-            LOG(Info, name, ": Running git clone for", target);
-            sp::io::Subprocess git_process({GIT, "clone", repo, target});
-            if (git_process.wait() != 0)
+            if (restoreCheckout())
             {
-                LOG(Error, name, ": Failed to clone repository", repo);
-                state = State::Error;
-                return false;
+                LOG(Warning, name, ": Update failed, keeping the last good build");
             }
-        }
-        else
-        {
-            LOG(Info, name, ": Running git pull for", target);
-            sp::io::Subprocess git_process({GIT, "pull"}, target);
-            if (git_process.wait() != 0)
+            else
             {
-                LOG(Error, name, ": Failed to pull repository", repo);
+                LOG(Error, name, ": Update failed, and the checkout could not be put back at the last good build");
                 state = State::Error;
-                return false;
             }
+            updating = false;
+            return false;
         }
-        return true;
+        state = State::Error;
+        updating = false;
+        return false;
+    }
+
+    //The update already changed the sources and assets the last good build runs with. Put the checkout back
+    //at the commit of that build, so the old executable never runs against the new files.
+    bool restoreCheckout()
+    {
+        GameStateStore::Record record;
+        if (!game_state_store.get(name, record) || record.commit == "")
+            return false;
+        if (git_backend->getHeadCommit(name) == record.commit)
+            return true;
+        LOG(Info, name, ": Putting the checkout back at", record.commit);
+        return git_backend->reset(name, record.commit, build_log);
+    }
+
+    void setReady()
+    {
+        //Decode the preview here on the build worker, so the main thread only has to upload it.
+        sp::string preview_file = name + "/preview.png";
+        TraceSpan span("preview load", name);
+        sp::Image image;
+        if (!thumbnail_cache.load(name, preview_file, image))
+        {
+            image = PreviewAtlas::loadCellImage(preview_file);
+            if (image.getSize().x > 0)
+                thumbnail_cache.store(name, preview_file, image);
+        }
+        if (image.getSize().x > 0)
+        {
+            PreviewAtlas::Entry entry = preview_atlas.add(preview_file, std::move(image));
+            std::lock_guard<std::mutex> lock(preview_mutex);
+            loaded_preview = entry;
+        }
+        //The game can already be in the ready state with its last good build, so flag the new preview as well.
+        preview_changed = true;
+        state = State::Ready;
+        updating = false;
+        markPlayable();
+        LOG(Info, name, ": Ready after", build_log.getTotalWallTime(), "seconds");
+        for(auto& timing : build_log.getTimings())
+            LOG(Info, name, ":", timing.wall_time, "s wall", timing.cpu_time, "s cpu:", timing.command);
     }
     
     enum class State
@@ -179,6 +498,17 @@ public:
     };
     State prev_update_state = State::Waiting;
     volatile State state = State::Waiting;
+    bool running = false;
+    std::atomic<bool> updating{false};  //Set while the load job changes the checkout, the game is not started then
+    Trace::Clock::time_point launch_end;
+    PreviewAtlas::Entry preview;
+    PreviewAtlas::Entry loaded_preview; //Set by the build worker, read by the main thread once the state is Ready
+    std::mutex preview_mutex;
+    std::atomic<bool> preview_changed{false};
+    bool cached_preview_loaded = false;
+    //What the carousel draws for this game.
+    PreviewAtlas::Entry display;
+    sp::Color display_color = sp::Color(1, 1, 1);
 
     static constexpr float inactivity_timeout = 60 * 5;
     sp::string name;
@@ -187,44 +517,40 @@ public:
     sp::string depends_repo;
     sp::string depends_path;
     std::vector<sp::string> build_commands;
+    BuildScheduler::JobId load_job = BuildScheduler::no_job;
+    BuildLog build_log;
+    //Changed catalog entry, applied once the running load job is done, as the build worker reads the current entry.
+    CatalogEntry pending_entry;
+    bool entry_changed = false;
 };
 
 class Spinner : public sp::Node
 {
 public:
     Spinner(sp::P<Node> parent, sp::P<sp::gui::Widget> gui, sp::string resource_name)
-    : sp::Node(parent), gui(gui)
+    : sp::Node(parent), gui(gui), resource_name(resource_name), catalog_watcher(resource_name, {"resources", "."})
     {
+        TraceSpan span("Spinner construction", resource_name);
         setRotation(sp::Quaterniond::fromAxisAngle(sp::Vector3d(0,1,0), 15));
 
         target_rotation = 0.0;
         rotation = 0;
 
-        for(auto& it : sp::io::KeyValueTreeLoader::loadResource(resource_name)->getFlattenNodesByIds())
-        {
-            sp::P<GameNode> game = add(it.first);
-            game->exec = it.second["exec"];
-            game->git = it.second["git"];
-            std::vector<sp::string> depends = it.second["depends"].split(" ");
-            if (depends.size() > 1)
-            {
-                game->depends_path = depends[0];
-                game->depends_repo = depends[1];
-            }
-            game->build_commands = it.second["build"].split("\n");
-        }
+        std::vector<CatalogEntry> entries;
+        if (!Catalog::load(resource_name, entries))
+            LOG(Error, "Failed to load", resource_name);
+        for(auto& entry : entries)
+            games.push_back(createGame(entry));
+        update();
+        updateCurrentGame();
     }
     
     void setActive(bool a)
     {
         active = a;
-        for(auto game_node : games)
-        {
-            if (active)
-                game_node->render_data.type = sp::RenderData::Type::Normal;
-            else
-                game_node->render_data.type = sp::RenderData::Type::None;
-        }
+        for(auto batch_node : batch_nodes)
+            batch_node->render_data.type = sp::RenderData::Type::None;
+        batches_dirty = true;
         if (active)
             updateCurrentGame();
     }
@@ -237,14 +563,39 @@ public:
     virtual void onFixedUpdate() override
     {
         if (!active) return;
-        rotation = rotation * 0.9 + target_rotation * 0.1;
+        //Stop easing once the rotation is closer than can be seen, so a static carousel stays static.
+        if (std::abs(rotation - target_rotation) < 0.01)
+        {
+            if (rotation == target_rotation)
+                return;
+            rotation = target_rotation;
+        }
+        else
+        {
+            rotation = rotation * 0.9 + target_rotation * 0.1;
+        }
         setRotation(sp::Quaterniond::fromAxisAngle(sp::Vector3d(0,1,0), 15) * sp::Quaterniond::fromAxisAngle(sp::Vector3d(1,0,0), rotation));
+        markActivity();
     }
     
     virtual void onUpdate(float delta) override
     {
-        if (!active) return;
-        float angle_per_item = 360.0 / float(games.size());
+        //Catalog changes wait until no game runs, the node of the running game has to stay around to see it stop.
+        if (!game_supervisor->isRunning())
+        {
+            if (catalog_watcher.hasChanged())
+                reloadCatalog();
+            applyPendingChanges();
+        }
+        if (!active || games.empty()) return;
+        //Only the games in view are polled, the running game is always the current one and thus in view.
+        for(int position=window_start; position<window_start+ring_size; position++)
+            if (getGameAt(position)->update())
+                batches_dirty = true;
+        if (batches_dirty)
+            updateBatches();
+        if (game_supervisor->isRunning()) return;
+        updateInfo();
         if (std::abs(rotation - target_rotation) < angle_per_item / 3.0)
         {
             if (up_key.getDown())
@@ -300,7 +651,7 @@ public:
                     camera_display_node->setPosition(sp::Vector3d(1, 0, -2));
                     camera_display_node->setRotation(-90);
                     camera_display_node->render_data.type = sp::RenderData::Type::Normal;
-                    camera_display_node->render_data.shader = sp::Shader::get("internal:basic.shader");
+                    camera_display_node->render_data.shader = camera_capture_texture->getShader();
                     camera_display_node->render_data.mesh = sp::MeshData::createDoubleSidedQuad(sp::Vector2f(4.0/3.0, 1));
                     camera_display_node->render_data.texture = camera_capture_texture;
                 }
@@ -308,24 +659,180 @@ public:
         }
     }
     
-    sp::P<GameNode> add(sp::string name)
+    Game* createGame(const CatalogEntry& entry)
+    {
+        Game* game = new Game(entry.name);
+        game->setEntry(entry);
+        game->restoreState();
+        return game;
+    }
+    
+    void scheduleLoad(BuildScheduler& scheduler)
     {
-        sp::P<sp::Node> rotation_node = new sp::Node(this);
-        sp::P<sp::Node> offset_node = new sp::Node(rotation_node);
-        GameNode* game = new GameNode(offset_node, name);
+        for(Game* game : games)
+            scheduleGameLoad(scheduler, game);
+        if (active)
+            updateCurrentGame();
+    }
 
-        games.push_back(game);
-        
+    void scheduleGameLoad(BuildScheduler& scheduler, Game* game)
+    {
+        std::vector<BuildScheduler::JobId> dependencies;
+        std::shared_ptr<BuildLog> depends_log;
+        if (game->depends_repo != "")
+        {
+            sp::string repo = game->depends_repo;
+            sp::string path = game->depends_path;
+            //Shared between the games of the depends group, so the output of this update does not end up in the log of a single game.
+            //When it fails, the games that wait for it copy the output into their own log.
+            std::shared_ptr<BuildLog>& log = depends_logs[path];
+            if (!log)
+                log = std::make_shared<BuildLog>();
+            depends_log = log;
+            dependencies.push_back(scheduler.addShared(path, [repo, path, log]()
+            {
+                TraceSpan span("git update", path);
+                auto git_start = std::chrono::steady_clock::now();
+                bool success = git_backend->update(repo, path, *log);
+                metrics.observe("arcade_depends_git_seconds", secondsSince(git_start), path);
+                if (!success)
+                {
+                    metrics.increment("arcade_depends_git_failures_total", path);
+                    for(auto& line : log->getLines())
+                        LOG(Error, path, ":", line);
+                }
+                return success;
+            }));
+        }
+        auto on_cancel = [game, depends_log]()
+        {
+            LOG(Error, game->name, ": Failed to update", game->depends_path);
+            game->build_log.clear();
+            if (depends_log)
+                for(auto& line : depends_log->getLines())
+                    game->build_log.addLine(line);
+            game->setFailed();
+        };
+        //The first game of a depends group fills the compiler cache with the engine objects, the other games of that group are ordered after it.
+        //Once the depends update ran, it releases them right away when the cache already has the objects of that depends commit.
+        //They still build when it fails, a broken game should not keep the others from building.
+        std::vector<BuildScheduler::JobId> after;
+        if (game->depends_path != "" && compiler_cache.isAvailable())
+        {
+            sp::string primer_key = "build:" + game->depends_path;
+            BuildScheduler::JobId primer = scheduler.findShared(primer_key);
+            if (primer == BuildScheduler::no_job)
+            {
+                sp::string depends_path = game->depends_path;
+                game->load_job = scheduler.addShared(primer_key, [game, depends_path, &scheduler]()
+                {
+                    sp::string depends_commit = git_backend->getHeadCommit(depends_path);
+                    if (compiler_cache.isPrimed(depends_path, depends_commit))
+                        scheduler.releaseCurrentJob();
+                    bool success = game->doASyncLoad();
+                    if (success)
+                        compiler_cache.setPrimed(depends_path, depends_commit);
+                    return success;
+                }, dependencies, on_cancel);
+                return;
+            }
+            after.push_back(primer);
+        }
+        game->load_job = scheduler.add([game]()
+        {
+            return game->doASyncLoad();
+        }, dependencies, on_cancel, after);
+    }
+
+    //Diff the catalog file against the games we have. Unchanged games keep their state, build and preview.
+    void reloadCatalog()
+    {
+        std::vector<CatalogEntry> entries;
+        if (!Catalog::load(resource_name, entries))
+        {
+            LOG(Warning, "Failed to reload", resource_name, ", keeping the current games");
+            return;
+        }
+        LOG(Info, "Reloading", resource_name);
+        std::vector<Game*> new_games;
+        for(auto& entry : entries)
+        {
+            Game* game = nullptr;
+            for(Game* g : games)
+                if (g->name == entry.name)
+                    game = g;
+            if (!game)
+                game = reviveRemovedGame(entry);
+            if (!game)
+            {
+                LOG(Info, entry.name, ": Added");
+                game = createGame(entry);
+                scheduleGameLoad(build_scheduler, game);
+            }
+            else if (game->getEntry() != entry)
+            {
+                LOG(Info, entry.name, ": Changed");
+                game->pending_entry = entry;
+                game->entry_changed = true;
+                build_scheduler.skip(game->load_job);
+            }
+            new_games.push_back(game);
+        }
+        for(Game* game : games)
+        {
+            if (std::find(new_games.begin(), new_games.end(), game) != new_games.end())
+                continue;
+            LOG(Info, game->name, ": Removed");
+            //The load job can still be running, so the game is only deleted once the job is done with it.
+            build_scheduler.skip(game->load_job);
+            removed_games.push_back(game);
+        }
+        games = new_games;
         update();
         updateCurrentGame();
-        return game;
+        markActivity();
     }
-    
-    void doASyncLoad()
+
+    //A game that was removed and added back can still have its load job running, and a second Game would build in the same directory.
+    //So the old one is taken back, and loaded again once that job is done.
+    Game* reviveRemovedGame(const CatalogEntry& entry)
+    {
+        for(auto it = removed_games.begin(); it != removed_games.end(); ++it)
+        {
+            Game* game = *it;
+            if (game->name != entry.name)
+                continue;
+            LOG(Info, entry.name, ": Added back");
+            removed_games.erase(it);
+            game->pending_entry = entry;
+            game->entry_changed = true;
+            return game;
+        }
+        return nullptr;
+    }
+
+    void applyPendingChanges()
     {
-        for(GameNode* game : games)
+        for(auto it = removed_games.begin(); it != removed_games.end(); )
+        {
+            Game* game = *it;
+            if (!build_scheduler.isFinished(game->load_job))
+            {
+                ++it;
+                continue;
+            }
+            delete game;
+            it = removed_games.erase(it);
+        }
+        for(Game* game : games)
         {
-            game->doASyncLoad();
+            if (!game->entry_changed || !build_scheduler.isFinished(game->load_job))
+                continue;
+            game->setEntry(game->pending_entry);
+            game->entry_changed = false;
+            scheduleGameLoad(build_scheduler, game);
+            if (active && game == current_game)
+                build_scheduler.prioritize(game->load_job);
         }
     }
     
@@ -335,52 +842,173 @@ private:
     float rotation;
     float target_rotation;
     
-    std::vector<GameNode*> games; //using an std::vector as sp::PList is not thread safe at all, even on a static list.
-    GameNode* current_game = nullptr;
+    std::vector<Game*> games; //using an std::vector as sp::PList is not thread safe at all, even on a static list.
+    std::vector<Game*> removed_games;   //Removed from the catalog, waiting for their load job to finish
+    Game* current_game = nullptr;
+
+    //The ring shows at most max_ring_size games, the ones around the current game. With more games in the catalog the
+    //slots at the back of the ring are reused for other games while turning, so only those games are polled and drawn.
+    static constexpr int max_ring_size = 25;
+    int ring_size = 0;
+    float angle_per_item = 360.0;
+    float distance = 0.0;
+    int current_position = 0;   //Position on the ring of the current game, not wrapped around.
+    int window_start = 0;
+
+    //The games in view are drawn as one mesh per atlas page and color, instead of a node per game.
+    struct Batch
+    {
+        sp::Texture* texture;
+        sp::Color color;
+        int order;
+        sp::MeshData::Vertices vertices;
+        sp::MeshData::Indices indices;
+    };
+    std::vector<sp::P<sp::Node>> batch_nodes;
+    bool batches_dirty = true;
     
     sp::P<sp::gui::Widget> gui;
+    sp::string info_caption;
+    sp::string resource_name;
+    CatalogWatcher catalog_watcher;
+    //Output of the depends repository updates, by path. Only used from the main thread.
+    static std::map<sp::string, std::shared_ptr<BuildLog>> depends_logs;
     
     void update()
     {
-        float distance = float(games.size()) * 1.2f / (2.0f * sp::pi);
-        float angle_per_item = 360.0 / float(games.size());
-        int index = 0;
-        for(auto node : getChildren())
-        {
-            node->setRotation(sp::Quaterniond::fromAxisAngle(sp::Vector3d(1,0,0), index * angle_per_item));
-            for(auto n : node->getChildren())
-                n->setPosition(sp::Vector3d(0, 0, distance));
-            index++;
-        }
+        ring_size = std::min(int(games.size()), max_ring_size);
+        angle_per_item = 360.0 / float(std::max(1, ring_size));
+        distance = float(ring_size) * 1.2f / (2.0f * sp::pi);
+        batches_dirty = true;
         
         setPosition(sp::Vector3d(-distance * 0.25, 0, -distance * 0.9 - 2));
     }
+
+    Game* getGameAt(int position)
+    {
+        int index = position % int(games.size());
+        if (index < 0)
+            index += games.size();
+        return games[index];
+    }
+
+    void updateBatches()
+    {
+        batches_dirty = false;
+        std::vector<Batch> batches;
+        for(int position=window_start; position<window_start+ring_size; position++)
+        {
+            Game* game = getGameAt(position);
+            if (!game->display.texture)
+                continue;
+            int order = position == current_position ? 1 : 0;
+            Batch* batch = nullptr;
+            for(auto& b : batches)
+            {
+                if (b.texture == game->display.texture && b.order == order
+                    && b.color.r == game->display_color.r && b.color.g == game->display_color.g && b.color.b == game->display_color.b && b.color.a == game->display_color.a)
+                    batch = &b;
+            }
+            if (!batch)
+            {
+                batches.push_back({game->display.texture, game->display_color, order, {}, {}});
+                batch = &batches.back();
+            }
+            addQuad(*batch, position * angle_per_item, game->display.uv0, game->display.uv1);
+        }
+
+        while(batch_nodes.size() < batches.size())
+        {
+            sp::P<sp::Node> node = new sp::Node(this);
+            node->render_data.shader = sp::Shader::get("internal:basic.shader");
+            batch_nodes.push_back(node);
+        }
+        for(size_t n=0; n<batch_nodes.size(); n++)
+        {
+            sp::P<sp::Node> node = batch_nodes[n];
+            if (n >= batches.size() || !active)
+            {
+                node->render_data.type = sp::RenderData::Type::None;
+                continue;
+            }
+            Batch& batch = batches[n];
+            node->render_data.type = sp::RenderData::Type::Normal;
+            node->render_data.texture = batch.texture;
+            node->render_data.color = batch.color;
+            node->render_data.order = batch.order;
+            if (node->render_data.mesh)
+                node->render_data.mesh->update(std::move(batch.vertices), std::move(batch.indices));
+            else
+                node->render_data.mesh = sp::MeshData::create(std::move(batch.vertices), std::move(batch.indices), sp::MeshData::Type::Dynamic);
+        }
+    }
+
+    //Add a double sided preview quad at the given angle on the ring, in the same place the node per game used to be.
+    void addQuad(Batch& batch, float angle, sp::Vector2f uv0, sp::Vector2f uv1)
+    {
+        float s = std::sin(angle / 180.0f * sp::pi);
+        float c = std::cos(angle / 180.0f * sp::pi);
+        auto corner = [&](float x, float y)
+        {
+            return sp::Vector3f(x, y * c - distance * s, y * s + distance * c);
+        };
+        sp::Vector3f normal(0, -s, c);
+        float w = 2.0f / 3.0f;
+        float h = 0.5f;
+        uint16_t base = batch.vertices.size();
+        batch.vertices.emplace_back(corner(-w, -h), normal, sp::Vector2f(uv0.x, uv0.y));
+        batch.vertices.emplace_back(corner( w, -h), normal, sp::Vector2f(uv1.x, uv0.y));
+        batch.vertices.emplace_back(corner(-w,  h), normal, sp::Vector2f(uv0.x, uv1.y));
+        batch.vertices.emplace_back(corner( w,  h), normal, sp::Vector2f(uv1.x, uv1.y));
+        for(int index : {0, 1, 2, 2, 1, 3, 2, 1, 0, 3, 1, 2})
+            batch.indices.push_back(base + index);
+    }
     
-    void updateCurrentGame()
+    //Only touch the label when the text changed, so the text is not laid out again every frame.
+    void updateInfo()
     {
-        if (current_game)
-            current_game->render_data.order = 0;
+        if (!current_game)
+            return;
+        sp::string info = current_game->getInfo();
+        if (info == info_caption)
+            return;
+        info_caption = info;
+        gui->getWidgetWithID("INFO")->setAttribute("caption", info);
+        markActivity();
+    }
 
-        float angle_per_item = 360.0 / float(games.size());
-        double item_offset = -target_rotation / angle_per_item;
-        while(item_offset < 0)
-            item_offset += games.size();
-        int index = item_offset + 0.5;
-        while(index >= int(games.size()))
-            index -= games.size();
-        for(GameNode* game : games)
+    void updateCurrentGame()
+    {
+        batches_dirty = true;
+        if (games.empty())
         {
-            if (index == 0)
-                current_game = game;
-            index--;
+            current_game = nullptr;
+            if (!active)
+                return;
+            gui->getWidgetWithID("NAME")->setAttribute("caption", "");
+            gui->getWidgetWithID("INFO")->setAttribute("caption", "");
+            info_caption = "";
+            return;
         }
+
+        current_position = std::floor(-target_rotation / angle_per_item + 0.5);
+        window_start = current_position - (ring_size - 1) / 2;
+        current_game = getGameAt(current_position);
+        for(int position=window_start; position<window_start+ring_size; position++)
+            getGameAt(position)->loadCachedPreview();
         
+        //Both carousels share the labels, only the one that is shown may touch them. setActive() fills them in later.
+        if (!active)
+            return;
         gui->getWidgetWithID("NAME")->setAttribute("caption", current_game->name);
-        gui->getWidgetWithID("INFO")->setAttribute("caption", current_game->git);
-        current_game->render_data.order = 1;
+        info_caption = "";
+        updateInfo();
+        build_scheduler.prioritize(current_game->load_job);
     }
 };
 
+std::map<sp::string, std::shared_ptr<BuildLog>> Spinner::depends_logs;
+
 class BetaSwitcher : public sp::Node
 {
 public:
@@ -391,6 +1019,8 @@ public:
 
     virtual void onFixedUpdate() override
     {
+        if (game_supervisor->isRunning())
+            return;
         if (timeout > 0)
         {
             timeout--;
@@ -414,6 +1044,7 @@ public:
         if (!normal_active)
             timeout = 60 * 60 * 5;
         gui->getWidgetWithID("BETA")->setVisible(!normal_active);
+        markActivity();
     }
     
 private:
@@ -424,15 +1055,179 @@ private:
 };
 
 
+//Lowers the frame rate of the launcher when nothing on screen changed for a while, to keep idle cabinets cool and quiet.
+//The engine has no way to skip rendering a frame, so this sleeps in the update instead, the same way as while a game runs.
+class IdleLimiter : public sp::Node
+{
+public:
+    IdleLimiter(sp::P<sp::Node> parent)
+    : sp::Node(parent)
+    {
+    }
+
+    virtual void onUpdate(float delta) override
+    {
+        //While a game runs, its Game already throttles the launcher.
+        idle_throttling = false;
+        if (game_supervisor->isRunning())
+            return;
+        for(sp::io::Keybinding* key : {&up_key, &down_key, &left_key, &right_key, &go_key, &switch_beta_key, &secret_key, &camera_key})
+            if (key->get())
+                markActivity();
+        if (camera_display_node)
+            markActivity();
+
+        auto now = std::chrono::steady_clock::now();
+        float idle_time = std::chrono::duration<float>(now - last_activity_time).count();
+        float frame_time = 0.0;
+        if (idle_time > deep_idle_delay)
+            frame_time = 1.0 / deep_idle_fps;
+        else if (idle_time > idle_delay)
+            frame_time = 1.0 / idle_fps;
+        idle_throttling = frame_time > 0.0;
+        float elapsed = std::chrono::duration<float>(now - last_frame_time).count();
+        if (elapsed < frame_time)
+            std::this_thread::sleep_for(std::chrono::duration<float>(frame_time - elapsed));
+        last_frame_time = std::chrono::steady_clock::now();
+    }
+private:
+    static constexpr float idle_delay = 2.0;
+    static constexpr float idle_fps = 10.0;
+    static constexpr float deep_idle_delay = 5 * 60.0;
+    static constexpr float deep_idle_fps = 4.0;
+
+    std::chrono::steady_clock::time_point last_frame_time;
+};
+
+
+//Records the launcher frame time and writes all metrics to a file every few seconds, for a local scraper to pick up.
+class MetricsWriter : public sp::Node
+{
+public:
+    MetricsWriter(sp::P<sp::Node> parent, sp::string filename)
+    : sp::Node(parent), filename(filename)
+    {
+    }
+
+    virtual void onUpdate(float delta) override
+    {
+        //While a game runs or the launcher is idle it sleeps on purpose, those frames say nothing about the launcher.
+        //The sleep of the idle limiter ends up in the next frame, so that frame is skipped as well.
+        if (!game_supervisor->isRunning() && !idle_throttling && !was_idle_throttling)
+            metrics.observe("arcade_frame_seconds", delta);
+        was_idle_throttling = idle_throttling;
+        write_delay -= delta;
+        if (write_delay <= 0.0)
+        {
+            write_delay = write_interval;
+            metrics.write(filename);
+        }
+    }
+private:
+    static constexpr float write_interval = 15.0;
+
+    sp::string filename;
+    float write_delay = 0.0;
+    bool was_idle_throttling = false;
+};
+
+static void addMetrics()
+{
+    metrics.addCounter("arcade_game_launches_total", "Number of times a game was started.");
+    metrics.addHistogram("arcade_game_session_seconds", "Time a game ran before it stopped.", {10, 30, 60, 120, 300, 600, 1200, 1800, 3600});
+    metrics.addCounter("arcade_game_inactivity_kills_total", "Number of times a game was stopped because nothing was pressed for too long.");
+    metrics.addHistogram("arcade_build_seconds", "Wall time of all build commands of a successful build.", {1, 5, 10, 30, 60, 120, 300, 600, 1200});
+    metrics.addCounter("arcade_build_failures_total", "Number of builds where a build command failed.");
+    metrics.addHistogram("arcade_git_seconds", "Wall time of updating a game repository.", {0.1, 0.5, 1, 2, 5, 10, 30, 60, 120});
+    metrics.addCounter("arcade_git_failures_total", "Number of failed game repository updates.");
+    //Depends repositories are shared by games, so they are labeled by their checkout path instead of a game.
+    metrics.addHistogram("arcade_depends_git_seconds", "Wall time of updating a depends repository.", {0.1, 0.5, 1, 2, 5, 10, 30, 60, 120}, "repository");
+    metrics.addCounter("arcade_depends_git_failures_total", "Number of failed depends repository updates.", "repository");
+    metrics.addHistogram("arcade_frame_seconds", "Launcher frame time while no game runs and the launcher is not idle.", {0.005, 0.010, 0.0167, 0.025, 0.033, 0.050, 0.100, 0.250, 0.500, 1.0});
+    metrics.addGauge("arcade_first_playable_seconds", "Time from launcher start until the first game could be played.");
+}
+
+
+//Run the performance test without the game carousel, and write the report as JSON or CSV.
+static int runBenchmark(sp::P<sp::Engine> engine, sp::string phases, sp::string format, sp::string output)
+{
+    if (format != "json" && format != "csv")
+    {
+        LOG(Error, "Unknown benchmark format:", format);
+        return 1;
+    }
+    if (output == "")
+        output = "/tmp/performance." + format;
+
+    sp::P<PerformanceTestScene> performance_test = new PerformanceTestScene();
+    if (phases != "" && !performance_test->selectPhases(phases.split(",")))
+        return 1;
+
+    int result = 0;
+    performance_test->finish_function = [engine, performance_test, format, output, &result](sp::string)
+    {
+        PerformanceReport& report = performance_test->getReport();
+        sp::string data = format == "csv" ? report.toCsv() : report.toJson();
+        FILE* f = output == "-" ? stdout : fopen(output.c_str(), "wt");
+        if (f)
+        {
+            fwrite(data.c_str(), data.length(), 1, f);
+            if (f != stdout)
+                fclose(f);
+            LOG(Info, "Benchmark report written to", output);
+        }
+        else
+        {
+            LOG(Error, "Failed to write benchmark report to", output);
+            result = 1;
+        }
+        engine->shutdown();
+    };
+    performance_test->enable();
+    engine->run();
+    return result;
+}
+
 int main(int argc, char** argv)
 {
+    bool benchmark = false;
+    sp::string benchmark_phases;
+    sp::string benchmark_format = "json";
+    sp::string benchmark_output;
+    sp::string metrics_file = "/tmp/arcade.prom";
+    for(int n=1; n<argc; n++)
+    {
+        sp::string argument = argv[n];
+        if (argument == "--benchmark")
+            benchmark = true;
+        else if (argument.startswith("--benchmark="))
+        {
+            benchmark = true;
+            benchmark_phases = argument.substr(12);
+        }
+        else if (argument.startswith("--benchmark-format="))
+            benchmark_format = argument.substr(19);
+        else if (argument.startswith("--benchmark-output="))
+            benchmark_output = argument.substr(19);
+        else if (argument.startswith("--trace="))
+            Trace::enable(argument.substr(8));
+        else if (argument.startswith("--metrics="))
+            metrics_file = argument.substr(10);
+        else
+            LOG(Warning, "Unknown argument:", argument);
+    }
+
+    Trace::Clock::time_point init_start = Trace::Clock::now();
     sp::P<sp::Engine> engine = new sp::Engine();
     //Create resource providers, so we can load things.
     new sp::io::DirectoryResourceProvider("resources");
     new sp::io::DirectoryResourceProvider(".");
     
     //Load our ui theme.
-    sp::gui::Theme::loadTheme("default", "gui/theme/basic.theme.txt");
+    {
+        TraceSpan span("theme load");
+        sp::gui::Theme::loadTheme("default", "gui/theme/basic.theme.txt");
+    }
     
     //Create a window to render on, and our engine.
     window = new sp::Window(4.0/3.0);
@@ -442,6 +1237,18 @@ int main(int argc, char** argv)
 #endif
     
     new sp::gui::Scene(sp::Vector2d(400, 300));
+
+    scene_layer = new sp::SceneGraphicsLayer(1);
+    scene_layer->addRenderPass(new sp::BasicNodeRenderPass());
+    window->addLayer(scene_layer);
+    Trace::addSpan("engine init", "", init_start, Trace::Clock::now());
+
+    if (benchmark)
+    {
+        int result = runBenchmark(engine, benchmark_phases, benchmark_format, benchmark_output);
+        Trace::write();
+        return result;
+    }
     
     scene = new sp::Scene("MAIN");
     camera = new sp::Camera(scene->getRoot());
@@ -449,28 +1256,47 @@ int main(int argc, char** argv)
     camera->setPosition(sp::Vector3d(0, 0, 0));
     scene->setDefaultCamera(camera);
 
-    sp::P<sp::gui::Widget> gui = sp::gui::Loader::load("main.gui", "MAIN");
+    addMetrics();
+    git_backend = GitBackend::create();
+    game_state_store.load();
+    loading_preview = preview_atlas.add("loading.png");
+    error_preview = preview_atlas.add("error.png");
+    game_supervisor = std::unique_ptr<GameSupervisor>(new GameSupervisor(key_monitor));
+    resource_governor = std::unique_ptr<ResourceGovernor>(new ResourceGovernor(build_scheduler));
+    game_supervisor->setCpuAffinity(resource_governor->getGameCpus());
+
+    sp::P<sp::gui::Widget> gui;
+    {
+        TraceSpan span("gui load", "main.gui");
+        gui = sp::gui::Loader::load("main.gui", "MAIN");
+    }
     Spinner* spinner_node = new Spinner(scene->getRoot(), gui, "games.txt");
     Spinner* spinner_node_beta = new Spinner(scene->getRoot(), gui, "beta_games.txt");
     new BetaSwitcher(scene->getRoot(), spinner_node, spinner_node_beta, gui);
+    new IdleLimiter(scene->getRoot());
+    if (metrics_file != "")
+        new MetricsWriter(scene->getRoot(), metrics_file);
     spinner_node->setActive(true);
     
-    scene_layer = new sp::SceneGraphicsLayer(1);
-    scene_layer->addRenderPass(new sp::BasicNodeRenderPass());
-    window->addLayer(scene_layer);
-    
-    std::thread async_load([spinner_node, spinner_node_beta]()
-    {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        spinner_node->doASyncLoad();
-        spinner_node_beta->doASyncLoad();
-    });
-    
     new PerformanceTestScene();
+
+    //Every game gets a load job, independent games are updated and built in parallel, the selected game first.
+    spinner_node->scheduleLoad(build_scheduler);
+    spinner_node_beta->scheduleLoad(build_scheduler);
+    setupBuildBudget();
+    build_scheduler.start(build_worker_count, ResourceGovernor::lowerThreadPriority);
+    key_monitor.start();
     
     engine->run();
 
-    async_load.join();
+    key_monitor.stop();
+    game_supervisor = nullptr;
+    //Resume paused builds first, the scheduler waits for the running jobs to finish.
+    resource_governor = nullptr;
+    build_scheduler.stop();
+    Trace::write();
+    if (metrics_file != "")
+        metrics.write(metrics_file);
     
     return 0;
 }
@@ -0,0 +1,169 @@
+#include "metrics.h"
+#include "fileUtil.h"
+
+#include <sp2/logging.h>
+
+#include <stdio.h>
+#include <cmath>
+
+
+void Metrics::addCounter(sp::string name, sp::string help, sp::string label)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    families[name] = {Type::Counter, help, {}, label, {}};
+}
+
+void Metrics::addGauge(sp::string name, sp::string help, sp::string label)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    families[name] = {Type::Gauge, help, {}, label, {}};
+}
+
+void Metrics::addHistogram(sp::string name, sp::string help, std::vector<double> buckets, sp::string label)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    families[name] = {Type::Histogram, help, buckets, label, {}};
+}
+
+void Metrics::increment(sp::string name, sp::string label_value, double amount)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Series* series = getSeries(name, label_value, Type::Counter);
+    if (series)
+        series->value += amount;
+}
+
+void Metrics::set(sp::string name, double value, sp::string label_value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Series* series = getSeries(name, label_value, Type::Gauge);
+    if (series)
+        series->value = value;
+}
+
+void Metrics::observe(sp::string name, double value, sp::string label_value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Series* series = getSeries(name, label_value, Type::Histogram);
+    if (!series)
+        return;
+    const std::vector<double>& buckets = families[name].buckets;
+    series->bucket_counts.resize(buckets.size());
+    //Buckets are stored without the counts of the lower buckets, they are summed up when writing.
+    for(unsigned int n=0; n<buckets.size(); n++)
+    {
+        if (value <= buckets[n])
+        {
+            series->bucket_counts[n]++;
+            break;
+        }
+    }
+    series->value += value;
+    series->count++;
+}
+
+sp::string Metrics::toText()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    sp::string result;
+    for(auto& it : families)
+    {
+        const sp::string& name = it.first;
+        Family& family = it.second;
+        const char* type_name = family.type == Type::Counter ? "counter" : family.type == Type::Gauge ? "gauge" : "histogram";
+        result += "# HELP " + name + " " + family.help + "\n";
+        result += "# TYPE " + name + " " + type_name + "\n";
+        for(auto& series_it : family.series)
+        {
+            const sp::string& label_value = series_it.first;
+            Series& series = series_it.second;
+            if (family.type != Type::Histogram)
+            {
+                result += name + formatLabels(family.label, label_value) + " " + formatValue(series.value) + "\n";
+                continue;
+            }
+            uint64_t cumulative = 0;
+            for(unsigned int n=0; n<family.buckets.size(); n++)
+            {
+                if (n < series.bucket_counts.size())
+                    cumulative += series.bucket_counts[n];
+                result += name + "_bucket" + formatLabels(family.label, label_value, formatValue(family.buckets[n])) + " " + formatCount(cumulative) + "\n";
+            }
+            result += name + "_bucket" + formatLabels(family.label, label_value, "+Inf") + " " + formatCount(series.count) + "\n";
+            result += name + "_sum" + formatLabels(family.label, label_value) + " " + formatValue(series.value) + "\n";
+            result += name + "_count" + formatLabels(family.label, label_value) + " " + formatCount(series.count) + "\n";
+        }
+    }
+    return result;
+}
+
+bool Metrics::write(sp::string filename)
+{
+    sp::string text = toText();
+    FILE* f = fopen((filename + ".tmp").c_str(), "wt");
+    if (!f)
+        return false;
+    bool success = fwrite(text.c_str(), text.length(), 1, f) == 1;
+    success = fclose(f) == 0 && success;
+    if (!success || !replaceFile(filename + ".tmp", filename))
+    {
+        LOG(Warning, "Failed to write metrics to", filename);
+        remove((filename + ".tmp").c_str());
+        return false;
+    }
+    return true;
+}
+
+Metrics::Series* Metrics::getSeries(const sp::string& name, const sp::string& label_value, Type type)
+{
+    auto it = families.find(name);
+    if (it == families.end() || it->second.type != type)
+    {
+        LOG(Warning, "Unknown metric:", name);
+        return nullptr;
+    }
+    return &it->second.series[label_value];
+}
+
+sp::string Metrics::formatValue(double value)
+{
+    if (std::isinf(value))
+        return value > 0 ? "+Inf" : "-Inf";
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+sp::string Metrics::formatCount(uint64_t count)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)count);
+    return buffer;
+}
+
+sp::string Metrics::formatLabels(const sp::string& label, const sp::string& value, const sp::string& le)
+{
+    std::vector<sp::string> labels;
+    if (value != "")
+    {
+        sp::string escaped;
+        for(char c : value)
+        {
+            if (c == '\\' || c == '"')
+                escaped += sp::string("\\") + c;
+            else if (c == '\n')
+                escaped += "\\n";
+            else
+                escaped += c;
+        }
+        labels.push_back(label + "=\"" + escaped + "\"");
+    }
+    if (le != "")
+        labels.push_back("le=\"" + le + "\"");
+    if (labels.empty())
+        return "";
+    sp::string result = "{" + labels[0];
+    for(unsigned int n=1; n<labels.size(); n++)
+        result += "," + labels[n];
+    return result + "}";
+}
@@ -0,0 +1,59 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <sp2/string.h>
+#include <mutex>
+#include <map>
+#include <vector>
+
+//In process counters, gauges and histograms, written as a Prometheus text file for a local scraper (node_exporter's textfile collector for example).
+//Every series can have one label, named game unless the metric was added with another label name. Metrics can be updated from any thread.
+class Metrics
+{
+public:
+    void addCounter(sp::string name, sp::string help, sp::string label="game");
+    void addGauge(sp::string name, sp::string help, sp::string label="game");
+    //buckets are the upper bounds, in increasing order. The +Inf bucket is added when writing.
+    void addHistogram(sp::string name, sp::string help, std::vector<double> buckets, sp::string label="game");
+
+    void increment(sp::string name, sp::string label_value="", double amount=1.0);
+    void set(sp::string name, double value, sp::string label_value="");
+    void observe(sp::string name, double value, sp::string label_value="");
+
+    sp::string toText();
+    //The file is written next to its final name and renamed, so the scraper never reads a half written file.
+    bool write(sp::string filename);
+private:
+    enum class Type
+    {
+        Counter,
+        Gauge,
+        Histogram
+    };
+    class Series
+    {
+    public:
+        double value = 0.0;     //Counter and gauge value, sum of the observations for histograms.
+        uint64_t count = 0;
+        std::vector<uint64_t> bucket_counts;
+    };
+    class Family
+    {
+    public:
+        Type type;
+        sp::string help;
+        std::vector<double> buckets;
+        sp::string label;
+        std::map<sp::string, Series> series;    //by label value, empty for no label
+    };
+
+    Series* getSeries(const sp::string& name, const sp::string& label_value, Type type);
+    static sp::string formatValue(double value);
+    static sp::string formatCount(uint64_t count);
+    static sp::string formatLabels(const sp::string& label, const sp::string& value, const sp::string& le="");
+
+    std::mutex mutex;
+    std::map<sp::string, Family> families;
+};
+
+#endif//METRICS_H
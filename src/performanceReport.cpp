@@ -0,0 +1,188 @@
+#include "performanceReport.h"
+
+#include <sp2/graphics/opengl.h>
+
+#include <stdio.h>
+#include <thread>
+
+#ifndef ARCADE_ENGINE_VERSION
+#define ARCADE_ENGINE_VERSION "unknown"
+#endif
+#ifndef ARCADE_VERSION
+#define ARCADE_VERSION "unknown"
+#endif
+
+
+static sp::string getGLString(GLenum name)
+{
+    const GLubyte* value = glGetString(name);
+    if (!value)
+        return "unknown";
+    return reinterpret_cast<const char*>(value);
+}
+
+static sp::string getCpuModel()
+{
+    FILE* f = fopen("/proc/cpuinfo", "rt");
+    if (!f)
+        return "unknown";
+    sp::string result = "unknown";
+    char buffer[512];
+    while(fgets(buffer, sizeof(buffer), f))
+    {
+        std::vector<sp::string> parts = sp::string(buffer).split(":", 1);
+        if (parts.size() == 2 && (parts[0].strip() == "model name" || parts[0].strip() == "Model"))
+        {
+            result = parts[1].strip();
+            break;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+static sp::string jsonString(const sp::string& value)
+{
+    sp::string result = "\"";
+    for(char c : value)
+    {
+        switch(c)
+        {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\t': result += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char buffer[8];
+                snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                result += buffer;
+            }
+            else
+            {
+                result += c;
+            }
+        }
+    }
+    return result + "\"";
+}
+
+static sp::string csvString(const sp::string& value)
+{
+    if (value.find_first_of(",\"\n") == sp::string::npos)
+        return value;
+    sp::string result = "\"";
+    for(char c : value)
+    {
+        if (c == '"')
+            result += "\"\"";
+        else
+            result += c;
+    }
+    return result + "\"";
+}
+
+void PerformanceReport::collectSystemInfo()
+{
+    system_info.clear();
+    system_info.emplace_back("launcher_version", ARCADE_VERSION);
+    system_info.emplace_back("engine_version", ARCADE_ENGINE_VERSION);
+    system_info.emplace_back("cpu", getCpuModel());
+    system_info.emplace_back("cpu_count", sp::string(int(std::thread::hardware_concurrency())));
+    system_info.emplace_back("gl_vendor", getGLString(GL_VENDOR));
+    system_info.emplace_back("gl_renderer", getGLString(GL_RENDERER));
+    system_info.emplace_back("gl_version", getGLString(GL_VERSION));
+}
+
+float PerformanceReport::getSpeedup(const Phase& phase)
+{
+    if (phase.baseline == "")
+        return 0.0;
+    for(auto& baseline : phases)
+        if (baseline.name == phase.baseline && baseline.good_node_count > 0)
+            return float(phase.good_node_count) / float(baseline.good_node_count);
+    return 0.0;
+}
+
+sp::string PerformanceReport::toText()
+{
+    sp::string result;
+    for(auto& phase : phases)
+    {
+        sp::string name = phase.name;
+        while(name.length() < 16)
+            name += " ";
+        result += name + sp::string(phase.good_node_count) + " " + sp::string(phase.max_node_count);
+        float speedup = getSpeedup(phase);
+        if (speedup > 0.0)
+        {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), " (%.2fx %s)", speedup, phase.baseline.c_str());
+            result += buffer;
+        }
+        result += "\n";
+    }
+    return result;
+}
+
+sp::string PerformanceReport::toJson()
+{
+    sp::string result = "{\n  \"system\": {";
+    for(unsigned int n=0; n<system_info.size(); n++)
+        result += sp::string(n ? "," : "") + "\n    " + jsonString(system_info[n].first) + ": " + jsonString(system_info[n].second);
+    result += "\n  },\n  \"phases\": [";
+    for(unsigned int n=0; n<phases.size(); n++)
+    {
+        Phase& phase = phases[n];
+        result += sp::string(n ? "," : "") + "\n    {\n";
+        result += "      \"name\": " + jsonString(phase.name) + ",\n";
+        result += "      \"good_node_count\": " + sp::string(phase.good_node_count) + ",\n";
+        result += "      \"max_node_count\": " + sp::string(phase.max_node_count) + ",\n";
+        if (phase.baseline != "")
+        {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "%.3f", getSpeedup(phase));
+            result += "      \"baseline\": " + jsonString(phase.baseline) + ",\n";
+            result += "      \"speedup\": " + sp::string(buffer) + ",\n";
+        }
+        result += "      \"samples\": [";
+        for(unsigned int m=0; m<phase.samples.size(); m++)
+        {
+            Sample& sample = phase.samples[m];
+            char buffer[512];
+            snprintf(buffer, sizeof(buffer), "%s\n        {\"node_count\": %d, \"fps\": %.2f, \"frame_ms\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}, \"fixed_update_ms\": %.3f, \"collision_ms\": %.3f, \"render_and_swap_ms\": %.3f, \"allocations_per_node\": %.1f, \"bytes_per_node\": %.1f}",
+                m ? "," : "", sample.node_count, sample.fps, sample.frame_p50, sample.frame_p95, sample.frame_p99, sample.frame_max, sample.fixed_update_p50, sample.collision_p50, sample.render_p50,
+                sample.allocations_per_node, sample.bytes_per_node);
+            result += buffer;
+        }
+        result += "\n      ]\n    }";
+    }
+    result += "\n  ]\n}\n";
+    return result;
+}
+
+sp::string PerformanceReport::toCsv()
+{
+    //One row per sample, with the system information repeated on every row so rows from multiple cabinets can simply be concatenated.
+    sp::string header;
+    sp::string system;
+    for(auto& it : system_info)
+    {
+        header += it.first + ",";
+        system += csvString(it.second) + ",";
+    }
+    sp::string result = header + "phase,good_node_count,max_node_count,node_count,fps,frame_p50_ms,frame_p95_ms,frame_p99_ms,frame_max_ms,fixed_update_ms,collision_ms,render_and_swap_ms,allocations_per_node,bytes_per_node\n";
+    for(auto& phase : phases)
+    {
+        for(auto& sample : phase.samples)
+        {
+            char buffer[256];
+            snprintf(buffer, sizeof(buffer), "%d,%d,%d,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f\n", phase.good_node_count, phase.max_node_count, sample.node_count, sample.fps,
+                sample.frame_p50, sample.frame_p95, sample.frame_p99, sample.frame_max, sample.fixed_update_p50, sample.collision_p50, sample.render_p50,
+                sample.allocations_per_node, sample.bytes_per_node);
+            result += system + csvString(phase.name) + "," + buffer;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef PERFORMANCE_REPORT_H
+#define PERFORMANCE_REPORT_H
+
+#include <sp2/string.h>
+#include <vector>
+
+//Results of a performance test run, together with the hardware and software it ran on.
+class PerformanceReport
+{
+public:
+    //Frame times of one step in a phase, in milliseconds.
+    class Sample
+    {
+    public:
+        int node_count;
+        float fps;
+        float frame_p50;
+        float frame_p95;
+        float frame_p99;
+        float frame_max;
+        float fixed_update_p50;
+        float collision_p50;    //Includes the fixed updates of other scenes
+        float render_p50;       //Everything between frames: rendering of all scenes, the buffer swap and waiting for vsync
+        //Allocations done to create and destroy a single node, only measured in the churn phase.
+        float allocations_per_node;
+        float bytes_per_node;
+    };
+    class Phase
+    {
+    public:
+        sp::string name;
+        int good_node_count = 0;    //Highest node count that still met the 60fps frame time budget
+        int max_node_count = 0;     //Node count at which the phase ended
+        sp::string baseline;        //Phase that does the same work in the original way, reported side by side with this one
+        std::vector<Sample> samples;
+    };
+
+    //Fill in the system information. Needs the OpenGL context, so call this from the main thread.
+    void collectSystemInfo();
+
+    //How many more nodes this phase handles compared to its baseline phase, or 0 when the baseline did not run.
+    float getSpeedup(const Phase& phase);
+
+    sp::string toText();
+    sp::string toJson();
+    sp::string toCsv();
+
+    std::vector<std::pair<sp::string, sp::string>> system_info;
+    std::vector<Phase> phases;
+};
+
+#endif//PERFORMANCE_REPORT_H
@@ -1,27 +1,155 @@
 #include "performanceTest.h"
+#include "allocationCounter.h"
+#include "trace.h"
 
 #include <sp2/engine.h>
 #include <sp2/scene/node.h>
 #include <sp2/graphics/meshdata.h>
 #include <sp2/graphics/textureManager.h>
+#include <sp2/graphics/texture.h>
+#include <sp2/graphics/gui/loader.h>
 #include <sp2/random.h>
 #include <sp2/collision/2d/circle.h>
 #include <sp2/scene/camera.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
 
 
 PerformanceTestScene::PerformanceTestScene()
 : sp::Scene("performance_test")
 {
     mesh = sp::MeshData::createQuad(sp::Vector2f(1, 1));
+    overdraw_mesh = sp::MeshData::createQuad(sp::Vector2f(80, 80));
 
     sp::Camera* camera = new sp::Camera(getRoot());
     camera->setOrtographic(100.0);
     setDefaultCamera(camera);
+
+    for(int n=0; n<int(State::Finished); n++)
+        selected_phases.push_back(State(n));
     
     disable();
 }
+
+bool PerformanceTestScene::selectPhases(std::vector<sp::string> names)
+{
+    if (names.empty())
+        return false;
+    std::vector<State> phases;
+    for(sp::string name : names)
+    {
+        int n;
+        for(n=0; n<int(State::Finished); n++)
+            if (getPhaseName(State(n)).lower() == name.strip().lower())
+                break;
+        if (n == int(State::Finished))
+        {
+            LOG(Error, "Unknown performance test phase:", name);
+            return false;
+        }
+        phases.push_back(State(n));
+    }
+    std::sort(phases.begin(), phases.end());
+    selected_phases = phases;
+    return true;
+}
+
+PerformanceTestScene::State PerformanceTestScene::getNextPhase(State current)
+{
+    for(State phase : selected_phases)
+        if (int(phase) > int(current))
+            return phase;
+    return State::Finished;
+}
+
+int PerformanceTestScene::getInitialStepCount(State phase)
+{
+    //Every overdraw quad covers a large part of the screen and every gui tree is a dozen widgets, so these start with smaller steps.
+    switch(phase)
+    {
+    case State::Scaling:    return 10000;
+    case State::Overdraw:   return 50;
+    case State::GuiLoad:    return 100;
+    case State::Churn:      return 100;
+    default:                return 1000;
+    }
+}
+
+bool PerformanceTestScene::isGravityPhase(State phase)
+{
+    return phase == State::Gravity || phase == State::GravityRender || phase == State::GravityNode || phase == State::GravityNodeRender
+        || phase == State::GravitySoA || phase == State::GravitySoARender || phase == State::Scaling;
+}
+
+PerformanceTestScene::State PerformanceTestScene::getBaselinePhase(State phase)
+{
+    switch(phase)
+    {
+    case State::GravitySoA:         return State::GravityNode;
+    case State::GravitySoARender:   return State::GravityNodeRender;
+    default:                        return State::Finished;
+    }
+}
+
+sp::string PerformanceTestScene::getPhaseName(State phase)
+{
+    switch(phase)
+    {
+    case State::NoRender:           return "NoRender";
+    case State::Render:             return "Render";
+    case State::Collision:          return "Collision";
+    case State::CollisionRender:    return "CollisionRender";
+    case State::Gravity:            return "Gravity";
+    case State::GravityRender:      return "GravityRender";
+    case State::GravityNode:        return "GravityNode";
+    case State::GravityNodeRender:  return "GravityNodeRender";
+    case State::GravitySoA:         return "GravitySoA";
+    case State::GravitySoARender:   return "GravitySoARender";
+    case State::Scaling:            return "Scaling";
+    case State::Textures:           return "Textures";
+    case State::Overdraw:           return "Overdraw";
+    case State::Text:               return "Text";
+    case State::GuiLoad:            return "GuiLoad";
+    case State::Churn:              return "Churn";
+    case State::Finished:           return "Finished";
+    }
+    return "";
+}
     
+static float seconds(PerformanceTestScene::Clock::duration duration)
+{
+    return std::chrono::duration<float>(duration).count();
+}
+
+static float percentile(std::vector<float> values, float p)
+{
+    std::sort(values.begin(), values.end());
+    int index = std::ceil(p * values.size()) - 1;
+    return values[std::max(0, std::min(index, int(values.size()) - 1))];
+}
+
 void PerformanceTestScene::onUpdate(float delta)
+{
+    Clock::time_point update_start = Clock::now();
+    if (!frame_started)
+        frame_start = update_start;
+
+    FrameTiming timing;
+    timing.frame = delta;
+    timing.fixed_update = fixed_update_time;
+    timing.collision = collision_time + (fixed_update_count > 0 ? seconds(update_start - last_fixed_update_end) : 0.0f);
+    timing.render = previous_update_end != Clock::time_point() ? seconds(frame_start - previous_update_end) : 0.0f;
+    frame_started = false;
+    fixed_update_count = 0;
+    fixed_update_time = 0.0;
+    collision_time = 0.0;
+
+    updateMeasurement(timing);
+    previous_update_end = Clock::now();
+}
+
+void PerformanceTestScene::updateMeasurement(const FrameTiming& timing)
 {
     if (ignore_next)
     {
@@ -30,28 +158,51 @@ void PerformanceTestScene::onUpdate(float delta)
     }
     if (measure_delay > 0)
     {
-        measure_delay -= delta;
+        measure_delay -= timing.frame;
         return;
     }
-    update_deltas.push_back(delta);
+    if (frame_timings.empty())
+    {
+        churn_allocation_count = 0;
+        churn_allocation_bytes = 0;
+        churn_node_count = 0;
+    }
+    frame_timings.push_back(timing);
     
-    if (update_deltas.size() == 10)
+    if (frame_timings.size() == sample_frame_count)
     {
         ignore_next = true;
 
-        std::sort(update_deltas.begin(), update_deltas.end());
-        float average = 0.0;
-        int average_count = 0;
-        for(unsigned int n=update_deltas.size()/3;n<=update_deltas.size()*2/3; n++)
+        std::vector<float> frame, fixed_update, collision, render;
+        for(auto& t : frame_timings)
         {
-            average += update_deltas[n];
-            average_count++;
+            frame.push_back(t.frame);
+            fixed_update.push_back(t.fixed_update);
+            collision.push_back(t.collision);
+            render.push_back(t.render);
         }
-        float fps = 1.0 / (average / average_count);
+        PerformanceReport::Sample sample;
+        sample.node_count = node_count;
+        sample.frame_p50 = percentile(frame, 0.50) * 1000.0;
+        sample.frame_p95 = percentile(frame, 0.95) * 1000.0;
+        sample.frame_p99 = percentile(frame, 0.99) * 1000.0;
+        sample.frame_max = percentile(frame, 1.0) * 1000.0;
+        sample.fixed_update_p50 = percentile(fixed_update, 0.50) * 1000.0;
+        sample.collision_p50 = percentile(collision, 0.50) * 1000.0;
+        sample.render_p50 = percentile(render, 0.50) * 1000.0;
+        sample.fps = 1000.0 / sample.frame_p50;
+        sample.allocations_per_node = churn_node_count ? float(churn_allocation_count) / churn_node_count : 0.0f;
+        sample.bytes_per_node = churn_node_count ? float(churn_allocation_bytes) / churn_node_count : 0.0f;
+        frame_timings.clear();
+
+        float fps = sample.fps;
         result_data.emplace_back(node_count, fps);
-        update_deltas.clear();
+        current_phase.samples.push_back(sample);
+        LOG(Info, node_count, "nodes, frame ms p50:", sample.frame_p50, "p95:", sample.frame_p95, "p99:", sample.frame_p99, "max:", sample.frame_max,
+            "fixed:", sample.fixed_update_p50, "collision:", sample.collision_p50, "render:", sample.render_p50);
         
-        if (fps > 59.0)
+        //A step only counts as good when the slow frames are within budget as well, a good average can hide stutter.
+        if (sample.frame_p95 <= frame_budget_p95 && sample.frame_p99 <= frame_budget_p99)
             good_fps_node_count = node_count;
         if (fps < 30.0)
         {
@@ -59,27 +210,42 @@ void PerformanceTestScene::onUpdate(float delta)
             {
                 LOG(Info, it.first, it.second);
             }
-            if (result_data.size() >= 30 || ((state == State::Gravity || state == State::GravityRender) && result_data.size() >= 10) || node_create_step_count == 1)
+            if (result_data.size() >= 30 || (isGravityPhase(state) && result_data.size() >= 10) || node_create_step_count == 1)
             {
-                switch(state)
+                current_phase.name = getPhaseName(state);
+                if (getBaselinePhase(state) != State::Finished)
+                    current_phase.baseline = getPhaseName(getBaselinePhase(state));
+                if (state == State::Scaling)
                 {
-                case State::NoRender:           result_text += "NoRender        "; break;
-                case State::Render:             result_text += "Render          "; break;
-                case State::Collision:          result_text += "Collision       "; break;
-                case State::CollisionRender:    result_text += "CollisionRender "; break;
-                case State::Gravity:            result_text += "Gravity         "; break;
-                case State::GravityRender:      result_text += "GravityRender   "; break;
-                case State::Finished: break;
+                    current_phase.name += sp::string(scaling_thread_count);
+                    if (scaling_thread_count > 1)
+                        current_phase.baseline = getPhaseName(state) + "1";
                 }
-                result_text += sp::string(good_fps_node_count) + " " + sp::string(result_data.back().first);
-                result_text += "\n";
+                current_phase.good_node_count = good_fps_node_count;
+                current_phase.max_node_count = result_data.back().first;
+                report.phases.push_back(current_phase);
+                Trace::addSpan("performance test phase", current_phase.name, phase_start, Clock::now());
+                phase_start = Clock::now();
+                current_phase = PerformanceReport::Phase();
+                result_text = report.toText();
 
-                state = State(int(state) + 1);
+                int max_thread_count = std::max(1, int(std::thread::hardware_concurrency()));
+                if (state == State::Scaling && scaling_thread_count < max_thread_count)
+                    scaling_thread_count = std::min(scaling_thread_count * 2, max_thread_count);
+                else
+                {
+                    state = getNextPhase(state);
+                    scaling_pool = nullptr;
+                }
 
                 if (state == State::Finished)
                 {
                     disable();
-                    sp::Scene::get("MAIN")->enable();
+                    report.collectSystemInfo();
+                    //There is no main scene when running as headless benchmark.
+                    sp::P<sp::Scene> main_scene = sp::Scene::get("MAIN");
+                    if (main_scene)
+                        main_scene->enable();
                     LOG(Info, result_text);
                     if (finish_function)
                         finish_function(result_text);
@@ -92,7 +258,7 @@ void PerformanceTestScene::onUpdate(float delta)
                     return;
                 }
                 
-                node_create_step_count = 1000;
+                node_create_step_count = getInitialStepCount(state);
                 good_fps_node_count = 0;
             }
             result_data.clear();
@@ -111,13 +277,23 @@ void PerformanceTestScene::onUpdate(float delta)
             for(int n=0; n<node_create_step_count; n++)
                 createNode();
         }
-        if (state == State::Gravity || state == State::GravityRender)
+        if (isGravityPhase(state))
             measure_delay = 2.0;
     }
 }
     
 void PerformanceTestScene::onFixedUpdate()
 {
+    Clock::time_point start = Clock::now();
+    if (!frame_started)
+    {
+        frame_started = true;
+        frame_start = start;
+    }
+    //A slow frame runs several fixed steps, the collision step of each earlier one lies between its end and this start.
+    if (fixed_update_count > 0)
+        collision_time += seconds(start - last_fixed_update_end);
+
     if (state == State::Gravity || state == State::GravityRender)
     {
         for(sp::P<sp::Node> node : getRoot()->getChildren())
@@ -125,24 +301,118 @@ void PerformanceTestScene::onFixedUpdate()
             node->setLinearVelocity(node->getLinearVelocity2D() - node->getPosition2D() * 0.1);
         }
     }
+    if (state == State::GravityNode || state == State::GravityNodeRender)
+    {
+        float delta = sp::Engine::fixed_update_delta;
+        for(sp::P<GravityNode>& node : gravity_nodes)
+        {
+            sp::Vector2d position = node->getPosition2D();
+            node->velocity -= position * 0.1;
+            node->setPosition(position + node->velocity * delta);
+        }
+    }
+    if (state == State::GravitySoA || state == State::GravitySoARender)
+    {
+        soa_gravity.update(sp::Engine::fixed_update_delta);
+        for(int n=0; n<soa_gravity.size(); n++)
+            soa_nodes[n]->setPosition(sp::Vector2d(soa_gravity.x[n], soa_gravity.y[n]));
+    }
+    if (state == State::Scaling)
+        updateScaling();
+    if (state == State::Churn)
+        createChurnNodes();
+
+    last_fixed_update_end = Clock::now();
+    fixed_update_time += seconds(last_fixed_update_end - start);
+    fixed_update_count++;
 }
 
 void PerformanceTestScene::onEnable(uint32_t flags)
 {
-    state = State::NoRender;
+    state = getNextPhase(State(-1));
+    scaling_thread_count = 1;
+    node_create_step_count = getInitialStepCount(state);
     result_text = "";
+    report = PerformanceReport();
+    current_phase = PerformanceReport::Phase();
+    phase_start = Clock::now();
+}
+
+sp::Texture* PerformanceTestScene::getDistinctTexture()
+{
+    //Every node gets its own small texture, until the pool is large enough that the texture switches are the bottleneck and not the memory.
+    static constexpr unsigned int texture_pool_size = 4096;
+    if (textures.size() >= texture_pool_size)
+        return textures[node_count % texture_pool_size].get();
+
+    static constexpr int texture_size = 16;
+    uint32_t color = 0xFF000000 | (sp::irandom(0, 0xFFFFFF));
+    std::vector<uint32_t> pixels(texture_size * texture_size);
+    for(int y=0; y<texture_size; y++)
+        for(int x=0; x<texture_size; x++)
+            pixels[x + y * texture_size] = ((x / 4 + y / 4) % 2) ? color : 0xFFFFFFFF;
+    sp::OpenGLTexture* texture = new sp::OpenGLTexture(sp::Texture::Type::Static, "PerformanceTest:" + sp::string(int(textures.size())));
+    texture->setImage(sp::Image(sp::Vector2i(texture_size, texture_size), std::move(pixels)));
+    textures.emplace_back(texture);
+    return texture;
 }
 
 void PerformanceTestScene::createNode()
 {
-    sp::Node* node = new sp::Node(getRoot());
-    if (state == State::Render || state == State::CollisionRender || state == State::GravityRender)
+    //In the churn phase the node count is the amount of nodes replaced every tick, the nodes themselves are created in onFixedUpdate.
+    if (state == State::Churn)
+    {
+        node_count++;
+        return;
+    }
+    if (state == State::Text || state == State::GuiLoad)
+    {
+        sp::P<sp::gui::Widget> widget = sp::gui::Loader::load("perf_test.gui", state == State::Text ? "TEXT" : "PANEL");
+        if (state == State::Text)
+            widget->setAttribute("caption", "Label " + sp::string(node_count) + " " + sp::string(sp::random(0, 1000)));
+        widget->setPosition(sp::Vector2d(sp::random(0, 350), sp::random(0, 270)));
+        gui_widgets.add(widget);
+        node_count++;
+        return;
+    }
+    //The scaling phase has no nodes at all, only the SoA data, so the threads do not touch the scene graph.
+    if (state == State::Scaling)
+    {
+        float x = sp::random(-100, 100);
+        float y = sp::random(-100, 100);
+        soa_gravity.add(x, y, -x, -y);
+        node_count++;
+        return;
+    }
+
+    sp::Node* node;
+    GravityNode* gravity_node = nullptr;
+    if (state == State::GravityNode || state == State::GravityNodeRender)
+        node = gravity_node = new GravityNode(getRoot());
+    else
+        node = new sp::Node(getRoot());
+    if (state == State::Render || state == State::CollisionRender || state == State::GravityRender || state == State::GravityNodeRender || state == State::GravitySoARender)
     {
         node->render_data.type = sp::RenderData::Type::Normal;
         node->render_data.shader = sp::Shader::get("internal:basic.shader");
         node->render_data.mesh = mesh;
         node->render_data.texture = sp::texture_manager.get("gui/theme/pixel.png");
     }
+    if (state == State::Textures)
+    {
+        node->render_data.type = sp::RenderData::Type::Normal;
+        node->render_data.shader = sp::Shader::get("internal:basic.shader");
+        node->render_data.mesh = mesh;
+        node->render_data.texture = getDistinctTexture();
+    }
+    if (state == State::Overdraw)
+    {
+        node->render_data.type = sp::RenderData::Type::Transparent;
+        node->render_data.shader = sp::Shader::get("internal:basic.shader");
+        node->render_data.mesh = overdraw_mesh;
+        node->render_data.texture = sp::texture_manager.get("gui/theme/pixel.png");
+        node->render_data.color = sp::Color(sp::random(0, 1), sp::random(0, 1), sp::random(0, 1), 0.05);
+    }
     node->setPosition(sp::Vector2d(sp::random(-100, 100), sp::random(-100, 100)));
     node->setRotation(sp::random(0, 360));
     if (state == State::Collision || state == State::CollisionRender || state == State::Gravity || state == State::GravityRender)
@@ -151,11 +421,68 @@ void PerformanceTestScene::createNode()
         if (state == State::Gravity || state == State::GravityRender)
             node->setLinearVelocity(-node->getPosition2D());
     }
+    if (gravity_node)
+    {
+        gravity_node->velocity = -node->getPosition2D();
+        gravity_nodes.push_back(gravity_node);
+    }
+    if (state == State::GravitySoA || state == State::GravitySoARender)
+    {
+        sp::Vector2d position = node->getPosition2D();
+        soa_gravity.add(position.x, position.y, -position.x, -position.y);
+        soa_nodes.push_back(node);
+    }
     node_count++;
 }
 
+void PerformanceTestScene::createChurnNodes()
+{
+    uint64_t allocation_count = AllocationCounter::getCount();
+    uint64_t allocation_bytes = AllocationCounter::getBytes();
+
+    for(sp::P<sp::Node>& node : churn_nodes)
+        node.destroy();
+    churn_nodes.clear();
+    for(int n=0; n<node_count; n++)
+    {
+        sp::Node* node = new sp::Node(getRoot());
+        node->render_data.type = sp::RenderData::Type::Normal;
+        node->render_data.shader = sp::Shader::get("internal:basic.shader");
+        node->render_data.mesh = mesh;
+        node->render_data.texture = sp::texture_manager.get("gui/theme/pixel.png");
+        node->setPosition(sp::Vector2d(sp::random(-100, 100), sp::random(-100, 100)));
+        node->setCollisionShape(sp::collision::Circle2D(1.0));
+        node->setLinearVelocity(sp::Vector2d(sp::random(-10, 10), sp::random(-10, 10)));
+        churn_nodes.push_back(node);
+    }
+
+    churn_allocation_count += AllocationCounter::getCount() - allocation_count;
+    churn_allocation_bytes += AllocationCounter::getBytes() - allocation_bytes;
+    churn_node_count += node_count;
+}
+
+void PerformanceTestScene::updateScaling()
+{
+    if (!scaling_pool || scaling_pool->getThreadCount() != scaling_thread_count)
+        scaling_pool = std::unique_ptr<WorkStealingPool>(new WorkStealingPool(scaling_thread_count));
+
+    soa_gravity.buildGrid();
+    scaling_pool->parallelFor(soa_gravity.size(), scaling_grain_size, [this](int begin, int end)
+    {
+        soa_gravity.collide(begin, end);
+    });
+    scaling_pool->parallelFor(soa_gravity.size(), scaling_grain_size, [this](int begin, int end)
+    {
+        soa_gravity.update(sp::Engine::fixed_update_delta, begin, end);
+    });
+}
+
 void PerformanceTestScene::eraseNodes()
 {
+    churn_nodes.clear();
+    soa_gravity.clear();
+    soa_nodes.clear();
+    gravity_nodes.clear();
     for(sp::P<sp::Node> node : getRoot()->getChildren())
     {
         sp::P<sp::Camera> camera = sp::P<sp::Node>(node);
@@ -163,4 +490,6 @@ void PerformanceTestScene::eraseNodes()
             continue;
         node.destroy();
     }
+    for(sp::P<sp::gui::Widget> widget : gui_widgets)
+        widget.destroy();
 }
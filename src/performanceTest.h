@@ -2,22 +2,44 @@
 #define PERFORMANCE_TEST_H
 
 #include <sp2/scene/scene.h>
+#include <sp2/graphics/gui/widget/widget.h>
+#include <chrono>
 
+#include "performanceReport.h"
+#include "soaGravity.h"
+#include "workStealingPool.h"
 
+
+//Finds how many nodes the engine can handle at 60fps, by adding nodes until the frame rate drops.
+//Besides plain nodes, phases ramp up distinct textures, large transparent quads, text labels and gui widget trees, the things our games run out of first.
+//The SoA gravity phases run gravity on contiguous arrays that are written back to the nodes. Their baseline are the GravityNode phases,
+//which run the same integration on velocities stored in the nodes, and also move the nodes with setPosition without collision bodies.
+//The Gravity phases move their nodes through box2d bodies instead, so they include the cost of collision.
+//The scaling phase runs SoA gravity and collision on a thread pool, once for 1, 2, 4... threads up to the core count, to see how the work scales with more cores.
+//The churn phase instead ramps the amount of nodes that is destroyed and created again every fixed tick, and counts the allocations this takes.
+//Every frame is split in three parts, measured between our own scene callbacks:
+// fixed update: our onFixedUpdate calls, where the per-node game logic runs.
+// collision: the gaps after each onFixedUpdate, until the next one or onUpdate, where the engine steps the collision world.
+//  This includes the fixed updates of other scenes, which do little while the test runs.
+// render: from the end of onUpdate until the first callback of the next frame. This is rendering of all scenes,
+//  the buffer swap and the wait for vsync, so it is reported as render_and_swap.
 class PerformanceTestScene : public sp::Scene
 {
 public:
+    typedef std::chrono::steady_clock Clock;
+
     PerformanceTestScene();
 
     virtual void onUpdate(float delta) override;
     virtual void onFixedUpdate() override;
     virtual void onEnable(uint32_t flags) override;
+
+    //Only run the phases with these names. Returns false when one of the names is not a known phase.
+    bool selectPhases(std::vector<sp::string> names);
+    //Report of the last finished run.
+    PerformanceReport& getReport() { return report; }
     
     std::function<void(sp::string)> finish_function;
-private:
-    void createNode();
-    void eraseNodes();
-
 private:
     enum class State
     {
@@ -27,19 +49,89 @@ private:
         CollisionRender,
         Gravity,
         GravityRender,
+        GravityNode,
+        GravityNodeRender,
+        GravitySoA,
+        GravitySoARender,
+        Scaling,
+        Textures,
+        Overdraw,
+        Text,
+        GuiLoad,
+        Churn,
         Finished
     } state;
-    
+
+    class FrameTiming
+    {
+    public:
+        float frame;
+        float fixed_update;
+        float collision;
+        float render;
+    };
+
+    void updateMeasurement(const FrameTiming& timing);
+    void createNode();
+    void createChurnNodes();
+    void updateScaling();
+    void eraseNodes();
+    sp::Texture* getDistinctTexture();
+    State getNextPhase(State current);
+    static int getInitialStepCount(State phase);
+    static bool isGravityPhase(State phase);
+    static State getBaselinePhase(State phase);
+    static sp::string getPhaseName(State phase);
+
+    //Keeps its velocity in the node itself, for the node based baseline of the SoA gravity phases.
+    class GravityNode : public sp::Node
+    {
+    public:
+        GravityNode(sp::P<sp::Node> parent) : sp::Node(parent) {}
+
+        sp::Vector2d velocity;
+    };
+
+private:
     std::shared_ptr<sp::MeshData> mesh;
+    std::shared_ptr<sp::MeshData> overdraw_mesh;
+    std::vector<std::unique_ptr<sp::Texture>> textures;
+    sp::PList<sp::gui::Widget> gui_widgets;
+    std::vector<sp::P<sp::Node>> churn_nodes;
+    SoAGravity soa_gravity;
+    std::vector<sp::P<sp::Node>> soa_nodes;
+    std::vector<sp::P<GravityNode>> gravity_nodes;
+    std::unique_ptr<WorkStealingPool> scaling_pool;
+    int scaling_thread_count = 1;
+    uint64_t churn_allocation_count = 0;
+    uint64_t churn_allocation_bytes = 0;
+    uint64_t churn_node_count = 0;
     float measure_delay = 0;
     int node_create_step_count = 1000;
     int node_count = 0;
     int good_fps_node_count = 0;
-    std::vector<float> update_deltas;
+    std::vector<FrameTiming> frame_timings;
     std::vector<std::pair<int, float>> result_data;
     bool ignore_next = true;
+    std::vector<State> selected_phases;
+
+    static constexpr unsigned int sample_frame_count = 60;
+    static constexpr float frame_budget_p95 = 17.5;    //ms
+    static constexpr float frame_budget_p99 = 25.0;    //ms
+    static constexpr int scaling_grain_size = 1024;
+
+    bool frame_started = false;
+    Clock::time_point frame_start;
+    Clock::time_point last_fixed_update_end;
+    Clock::time_point previous_update_end;
+    Clock::time_point phase_start;
+    float fixed_update_time = 0.0;
+    float collision_time = 0.0;
+    int fixed_update_count = 0;
     
     sp::string result_text;
+    PerformanceReport report;
+    PerformanceReport::Phase current_phase;
 };
 
 #endif//PERFORMANCE_TEST_H
@@ -0,0 +1,131 @@
+#include "previewAtlas.h"
+#include "trace.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/resourceProvider.h>
+#include <sp2/graphics/opengl.h>
+
+
+PreviewAtlas::Entry PreviewAtlas::add(sp::string resource_name)
+{
+    sp::Image image = loadCellImage(resource_name);
+    if (image.getSize().x <= 0)
+        return Entry();
+    return add(resource_name, std::move(image));
+}
+
+PreviewAtlas::Entry PreviewAtlas::add(sp::string name, sp::Image&& image)
+{
+    if (image.getSize().x != cell_width || image.getSize().y != cell_height)
+        image = scale(image);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    int cell;
+    if (it != entries.end())
+    {
+        cell = it->second.first;
+    }
+    else
+    {
+        cell = cell_count++;
+        if (cell / cells_per_page >= int(pages.size()))
+            pages.push_back(new Page(pages.size()));
+    }
+    Page* page = pages[cell / cells_per_page];
+    sp::Vector2i position((cell % cells_per_page) % cells_per_row * cell_width, (cell % cells_per_page) / cells_per_row * cell_height);
+    page->addUpload(position, std::move(image));
+
+    if (it != entries.end())
+        return it->second.second;
+
+    //Keep half a texel away from the cell border, so linear filtering does not pick up the neighbouring cells.
+    Entry entry;
+    entry.texture = page;
+    sp::Vector2f uv0((position.x + 0.5f) / page_size, (position.y + cell_height - 0.5f) / page_size);
+    sp::Vector2f uv1((position.x + cell_width - 0.5f) / page_size, (position.y + 0.5f) / page_size);
+    entry.uv0 = uv0;
+    entry.uv1 = uv1;
+    entries[name] = {cell, entry};
+    return entry;
+}
+
+sp::Image PreviewAtlas::loadCellImage(sp::string resource_name)
+{
+    TraceSpan span("preview decode", resource_name);
+    sp::Image image;
+    sp::io::ResourceStreamPtr stream = sp::io::ResourceProvider::get(resource_name);
+    if (!stream)
+        return image;
+    if (!image.loadFromStream(stream) || image.getSize().x <= 0)
+    {
+        LOG(Warning, "Failed to load preview image", resource_name);
+        return sp::Image();
+    }
+    if (image.getSize().x != cell_width || image.getSize().y != cell_height)
+        image = scale(image);
+    return image;
+}
+
+sp::Image PreviewAtlas::scale(const sp::Image& image)
+{
+    //Box filter, every target pixel is the average of the source pixels it covers.
+    sp::Vector2i source_size = image.getSize();
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(image.getPtr());
+    std::vector<uint32_t> pixels(cell_width * cell_height);
+    uint8_t* target = reinterpret_cast<uint8_t*>(pixels.data());
+    for(int y=0; y<cell_height; y++)
+    {
+        int y0 = y * source_size.y / cell_height;
+        int y1 = std::max(y0 + 1, (y + 1) * source_size.y / cell_height);
+        for(int x=0; x<cell_width; x++)
+        {
+            int x0 = x * source_size.x / cell_width;
+            int x1 = std::max(x0 + 1, (x + 1) * source_size.x / cell_width);
+            uint32_t sum[4] = {0, 0, 0, 0};
+            for(int sy=y0; sy<y1; sy++)
+            {
+                for(int sx=x0; sx<x1; sx++)
+                {
+                    const uint8_t* p = source + (sy * source_size.x + sx) * 4;
+                    for(int c=0; c<4; c++)
+                        sum[c] += p[c];
+                }
+            }
+            int count = (y1 - y0) * (x1 - x0);
+            uint8_t* p = target + (y * cell_width + x) * 4;
+            for(int c=0; c<4; c++)
+                p[c] = sum[c] / count;
+        }
+    }
+    return sp::Image(sp::Vector2i(cell_width, cell_height), std::move(pixels));
+}
+
+PreviewAtlas::Page::Page(int index)
+: sp::OpenGLTexture(sp::Texture::Type::Dynamic, "PreviewAtlas:" + sp::string(index))
+{
+    setImage(sp::Image(sp::Vector2i(page_size, page_size), 0x00000000));
+}
+
+void PreviewAtlas::Page::addUpload(sp::Vector2i position, sp::Image&& image)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_uploads.emplace_back(position, std::move(image));
+}
+
+void PreviewAtlas::Page::bind()
+{
+    sp::OpenGLTexture::bind();
+
+    std::vector<std::pair<sp::Vector2i, sp::Image>> uploads;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending_uploads.empty())
+            return;
+        std::swap(uploads, pending_uploads);
+    }
+    //The base class just bound our texture, so we can update the new cells in place instead of uploading the whole page again.
+    TraceSpan span("preview upload", sp::string(int(uploads.size())) + " cells");
+    for(auto& upload : uploads)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, upload.first.x, upload.first.y, cell_width, cell_height, GL_RGBA, GL_UNSIGNED_BYTE, upload.second.getPtr());
+}
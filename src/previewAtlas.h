@@ -0,0 +1,60 @@
+#ifndef PREVIEW_ATLAS_H
+#define PREVIEW_ATLAS_H
+
+#include <sp2/graphics/texture.h>
+#include <mutex>
+#include <map>
+
+//Packs all game preview images into a few large textures, so the carousel binds the same texture for every game.
+//Images are decoded and scaled down on the calling thread, which is normally a build worker.
+//Only the upload of the new cell is left for the render thread.
+class PreviewAtlas
+{
+public:
+    class Entry
+    {
+    public:
+        sp::Texture* texture = nullptr;
+        //Texture coordinates of the bottom left and top right corner, for drawing many entries in one mesh.
+        sp::Vector2f uv0;
+        sp::Vector2f uv1;
+
+        bool isValid() const { return texture != nullptr; }
+    };
+
+    //Load an image resource into the atlas. Can be called from any thread.
+    //Adding the same name again replaces the image in the same cell.
+    Entry add(sp::string resource_name);
+    Entry add(sp::string name, sp::Image&& image);
+
+    //Decode an image resource and scale it to the cell size. Returns an empty image on failure.
+    static sp::Image loadCellImage(sp::string resource_name);
+
+    static constexpr int cell_width = 256;
+    static constexpr int cell_height = 192;
+private:
+    class Page : public sp::OpenGLTexture
+    {
+    public:
+        Page(int index);
+
+        void addUpload(sp::Vector2i position, sp::Image&& image);
+        virtual void bind() override;
+    private:
+        std::mutex mutex;
+        std::vector<std::pair<sp::Vector2i, sp::Image>> pending_uploads;
+    };
+
+    static constexpr int page_size = 2048;
+    static constexpr int cells_per_row = page_size / cell_width;
+    static constexpr int cells_per_page = cells_per_row * (page_size / cell_height);
+
+    static sp::Image scale(const sp::Image& image);
+
+    std::mutex mutex;
+    std::vector<Page*> pages;
+    std::map<sp::string, std::pair<int, Entry>> entries;
+    int cell_count = 0;
+};
+
+#endif//PREVIEW_ATLAS_H
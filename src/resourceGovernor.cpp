@@ -0,0 +1,228 @@
+#include "resourceGovernor.h"
+#include "buildScheduler.h"
+
+#include <sp2/logging.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __WIN32__
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+//From linux/ioprio.h, which is not available everywhere.
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#endif//__WIN32__
+
+//Cores that fit in a cpu_set_t.
+#ifdef CPU_SETSIZE
+static constexpr int max_cpu_count = CPU_SETSIZE;
+#else
+static constexpr int max_cpu_count = 1024;
+#endif
+
+
+ResourceGovernor::ResourceGovernor(BuildScheduler& scheduler)
+: scheduler(scheduler)
+{
+    const char* env = getenv("ARCADE_BUILD_WHILE_PLAYING");
+    if (env && sp::string(env) == "throttle")
+        pause_builds = false;
+    setupCgroup();
+    CapturedProcess::setHooks(this);
+}
+
+ResourceGovernor::~ResourceGovernor()
+{
+    CapturedProcess::setHooks(nullptr);
+    setGameRunning(false);
+#ifndef __WIN32__
+    if (cgroup_procs_fd >= 0)
+        close(cgroup_procs_fd);
+#endif//__WIN32__
+}
+
+#ifdef __WIN32__
+//There are no cgroups on Windows, only jobs that did not start yet are paused while a game runs.
+void ResourceGovernor::setupCgroup()
+{
+}
+
+bool ResourceGovernor::writeCgroupFile(sp::string name, sp::string value)
+{
+    return false;
+}
+
+void ResourceGovernor::lowerThreadPriority()
+{
+    //Background mode lowers the cpu, io and memory priority of the worker thread.
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN))
+        LOG(Warning, "Failed to lower the build worker priority");
+}
+#else
+void ResourceGovernor::setupCgroup()
+{
+    //Our own cgroup is the "0::<path>" line of /proc/self/cgroup on a cgroup v2 system. The build cgroup is created below it,
+    //which works when the launcher runs in a delegated cgroup, like a systemd user service.
+    FILE* f = fopen("/proc/self/cgroup", "rt");
+    if (!f)
+        return;
+    char buffer[512];
+    sp::string own_path;
+    while(fgets(buffer, sizeof(buffer), f))
+    {
+        sp::string line = sp::string(buffer).strip();
+        if (line.startswith("0::"))
+            own_path = line.substr(3);
+    }
+    fclose(f);
+    if (own_path == "")
+        return;
+
+    sp::string path = "/sys/fs/cgroup" + own_path + "/arcade_builds";
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        LOG(Info, "No writable cgroup for background builds, using signals to pause them");
+        return;
+    }
+    cgroup_procs_fd = open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (cgroup_procs_fd < 0)
+        return;
+    cgroup_path = path;
+    //The cpu and io controllers are often not enabled for our cgroup, in which case the idle priorities still apply.
+    writeCgroupFile("cpu.weight", "1");
+    writeCgroupFile("io.weight", "1");
+    writeCgroupFile("cgroup.freeze", "0");
+    LOG(Info, "Background builds run in cgroup", cgroup_path);
+}
+
+bool ResourceGovernor::writeCgroupFile(sp::string name, sp::string value)
+{
+    int fd = open((cgroup_path + "/" + name).c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool result = write(fd, value.c_str(), value.length()) == ssize_t(value.length());
+    close(fd);
+    return result;
+}
+
+void ResourceGovernor::lowerThreadPriority()
+{
+    //On Linux the nice value, scheduling policy and io priority are per thread, and are inherited by forked processes.
+    if (setpriority(PRIO_PROCESS, 0, 19) != 0)
+        LOG(Warning, "Failed to lower the build worker nice value");
+    sched_param param;
+    param.sched_priority = 0;
+    sched_setscheduler(0, SCHED_IDLE, &param);
+#ifdef SYS_ioprio_set
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+#endif//__WIN32__
+
+void ResourceGovernor::setGameRunning(bool running)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (game_running == running)
+        return;
+    game_running = running;
+    if (!pause_builds)
+        return;
+
+    //Jobs that did not start yet wait, running processes are frozen. Work done inside a job itself, like a libgit2 fetch, is not paused.
+    //The processes are signalled as well, in case moving them into the cgroup failed.
+    scheduler.setPaused(running);
+    if (cgroup_path != "")
+        writeCgroupFile("cgroup.freeze", running ? "1" : "0");
+#ifndef __WIN32__
+    for(pid_t pid : processes)
+        kill(-pid, running ? SIGSTOP : SIGCONT);
+#endif//__WIN32__
+}
+
+std::vector<int> ResourceGovernor::getGameCpus()
+{
+    std::vector<int> result;
+    const char* env = getenv("ARCADE_GAME_CPUS");
+    if (!env)
+        return result;
+    //Parts that do not parse are logged and skipped, a typo should not keep the launcher from starting.
+    auto parseCpu = [](const sp::string& str, int& cpu)
+    {
+        const char* begin = str.c_str();
+        char* end = nullptr;
+        long value = strtol(begin, &end, 10);
+        if (end == begin || *end != '\0' || value < 0 || value >= max_cpu_count)
+            return false;
+        cpu = value;
+        return true;
+    };
+    for(sp::string part : sp::string(env).split(","))
+    {
+        part = part.strip();
+        if (part == "")
+            continue;
+        std::vector<sp::string> range = part.split("-");
+        int first, last;
+        if (range.size() == 1 && parseCpu(range[0].strip(), first))
+            last = first;
+        else if (range.size() != 2 || !parseCpu(range[0].strip(), first) || !parseCpu(range[1].strip(), last) || last < first)
+        {
+            LOG(Warning, "Ignoring", part, "in ARCADE_GAME_CPUS, expected a core number or range below", max_cpu_count);
+            continue;
+        }
+        for(int n=first; n<=last; n++)
+            result.push_back(n);
+    }
+    return result;
+}
+
+#ifdef __WIN32__
+//Build commands run through sp::io::Subprocess on Windows, so the hooks are never called.
+void ResourceGovernor::onChildStart()
+{
+}
+
+void ResourceGovernor::onStarted(pid_t pid)
+{
+}
+
+void ResourceGovernor::onFinished(pid_t pid)
+{
+}
+#else
+void ResourceGovernor::onChildStart()
+{
+    //Runs in the forked child, so only async-signal-safe calls. Writing 0 moves the writing process itself.
+    if (cgroup_procs_fd >= 0)
+    {
+        if (write(cgroup_procs_fd, "0", 1) < 0)
+        {
+            //Stays in the launcher cgroup, so it is paused with signals only.
+        }
+    }
+}
+
+void ResourceGovernor::onStarted(pid_t pid)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    processes.insert(pid);
+    //A job that was already running when the game started can still start new commands.
+    if (game_running && pause_builds)
+        kill(-pid, SIGSTOP);
+}
+
+void ResourceGovernor::onFinished(pid_t pid)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    processes.erase(pid);
+}
+#endif//__WIN32__
@@ -0,0 +1,49 @@
+#ifndef RESOURCE_GOVERNOR_H
+#define RESOURCE_GOVERNOR_H
+
+#include "capturedProcess.h"
+
+#include <sp2/string.h>
+#include <mutex>
+#include <set>
+#include <vector>
+
+class BuildScheduler;
+
+//Keeps the git and build work in the background from slowing down the game that is being played.
+//Build workers, and everything they start, run at idle cpu and io priority. Build processes are put in their own cgroup when
+//the cgroup v2 hierarchy is writable, so they can be frozen as a whole while a game runs. Without a cgroup they are stopped with SIGSTOP instead.
+//Set ARCADE_BUILD_WHILE_PLAYING=throttle to keep building at idle priority while a game runs, instead of pausing.
+class ResourceGovernor : public CapturedProcess::Hooks
+{
+public:
+    ResourceGovernor(BuildScheduler& scheduler);
+    ~ResourceGovernor();
+
+    //Called on every build worker thread when it starts. Processes started from the thread inherit its priority.
+    static void lowerThreadPriority();
+
+    //Pause or resume the background work, called when a game starts and stops.
+    void setGameRunning(bool running);
+
+    //Cores the game is pinned to, from ARCADE_GAME_CPUS (like "2,3" or "2-3"). Empty when the game can use any core.
+    std::vector<int> getGameCpus();
+
+    virtual void onChildStart() override;
+    virtual void onStarted(pid_t pid) override;
+    virtual void onFinished(pid_t pid) override;
+private:
+    void setupCgroup();
+    bool writeCgroupFile(sp::string name, sp::string value);
+
+    BuildScheduler& scheduler;
+    bool pause_builds = true;
+    sp::string cgroup_path;
+    int cgroup_procs_fd = -1;
+
+    std::mutex mutex;
+    bool game_running = false;
+    std::set<pid_t> processes;
+};
+
+#endif//RESOURCE_GOVERNOR_H
@@ -0,0 +1,117 @@
+#include "soaGravity.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+void SoAGravity::add(float px, float py, float vx, float vy)
+{
+    x.push_back(px);
+    y.push_back(py);
+    velocity_x.push_back(vx);
+    velocity_y.push_back(vy);
+}
+
+void SoAGravity::clear()
+{
+    x.clear();
+    y.clear();
+    velocity_x.clear();
+    velocity_y.clear();
+}
+
+void SoAGravity::update(float delta)
+{
+    update(delta, 0, size());
+}
+
+void SoAGravity::update(float delta, int begin, int end)
+{
+    float* px = x.data();
+    float* py = y.data();
+    float* vx = velocity_x.data();
+    float* vy = velocity_y.data();
+    int n = begin;
+#ifdef __SSE2__
+    __m128 pull = _mm_set1_ps(0.1f);
+    __m128 step = _mm_set1_ps(delta);
+    for(; n + 4 <= end; n += 4)
+    {
+        __m128 x4 = _mm_loadu_ps(px + n);
+        __m128 y4 = _mm_loadu_ps(py + n);
+        __m128 vx4 = _mm_sub_ps(_mm_loadu_ps(vx + n), _mm_mul_ps(x4, pull));
+        __m128 vy4 = _mm_sub_ps(_mm_loadu_ps(vy + n), _mm_mul_ps(y4, pull));
+        _mm_storeu_ps(vx + n, vx4);
+        _mm_storeu_ps(vy + n, vy4);
+        _mm_storeu_ps(px + n, _mm_add_ps(x4, _mm_mul_ps(vx4, step)));
+        _mm_storeu_ps(py + n, _mm_add_ps(y4, _mm_mul_ps(vy4, step)));
+    }
+#endif
+    //Scalar version for the remaining objects, and for platforms without SSE2.
+    for(; n < end; n++)
+    {
+        vx[n] -= px[n] * 0.1f;
+        vy[n] -= py[n] * 0.1f;
+        px[n] += vx[n] * delta;
+        py[n] += vy[n] * delta;
+    }
+}
+
+int SoAGravity::getCell(float px, float py)
+{
+    int cx = std::max(0, std::min(grid_size - 1, int(std::floor(px / cell_size)) + grid_size / 2));
+    int cy = std::max(0, std::min(grid_size - 1, int(std::floor(py / cell_size)) + grid_size / 2));
+    return cx + cy * grid_size;
+}
+
+void SoAGravity::buildGrid()
+{
+    //Counting sort of the objects on their cell, so the objects of a cell are next to each other in cell_objects.
+    cell_start.assign(grid_size * grid_size + 1, 0);
+    object_cell.resize(size());
+    for(int n=0; n<size(); n++)
+    {
+        object_cell[n] = getCell(x[n], y[n]);
+        cell_start[object_cell[n] + 1]++;
+    }
+    for(unsigned int n=1; n<cell_start.size(); n++)
+        cell_start[n] += cell_start[n - 1];
+    cell_objects.resize(size());
+    std::vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+    for(int n=0; n<size(); n++)
+        cell_objects[fill[object_cell[n]]++] = n;
+}
+
+void SoAGravity::collide(int begin, int end)
+{
+    const float min_distance = radius * 2.0f;
+    for(int n=begin; n<end; n++)
+    {
+        int cx = object_cell[n] % grid_size;
+        int cy = object_cell[n] / grid_size;
+        for(int ny=std::max(0, cy - 1); ny<=std::min(grid_size - 1, cy + 1); ny++)
+        {
+            for(int nx=std::max(0, cx - 1); nx<=std::min(grid_size - 1, cx + 1); nx++)
+            {
+                int cell = nx + ny * grid_size;
+                for(int m=cell_start[cell]; m<cell_start[cell + 1]; m++)
+                {
+                    int other = cell_objects[m];
+                    float dx = x[n] - x[other];
+                    float dy = y[n] - y[other];
+                    float distance_squared = dx * dx + dy * dy;
+                    if (other == n || distance_squared >= min_distance * min_distance || distance_squared <= 0.0f)
+                        continue;
+                    float distance = std::sqrt(distance_squared);
+                    float push = (min_distance - distance) / distance;
+                    velocity_x[n] += dx * push;
+                    velocity_y[n] += dy * push;
+                }
+            }
+        }
+    }
+}
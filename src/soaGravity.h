@@ -0,0 +1,41 @@
+#ifndef SOA_GRAVITY_H
+#define SOA_GRAVITY_H
+
+#include <vector>
+
+
+//Positions and velocities of many objects in separate contiguous arrays, so the gravity update can work on 4 objects at once.
+class SoAGravity
+{
+public:
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> velocity_x;
+    std::vector<float> velocity_y;
+
+    void add(float px, float py, float vx, float vy);
+    void clear();
+    int size() const { return x.size(); }
+
+    //Pull every object towards the origin and move it, the same gravity as the node based performance test phases.
+    void update(float delta);
+    //Update only the objects in [begin, end), so the work can be split over multiple threads.
+    void update(float delta, int begin, int end);
+
+    //Sort the objects into a grid of cells as large as the objects, needed before collide.
+    void buildGrid();
+    //Push the objects in [begin, end) away from the objects they overlap with. Only changes the velocity of those objects, so ranges can run in parallel.
+    void collide(int begin, int end);
+private:
+    static constexpr float radius = 1.0;
+    static constexpr int grid_size = 128;   //Cells per side, objects outside the grid are put in the border cells
+    static constexpr float cell_size = radius * 2.0f;
+
+    int getCell(float px, float py);
+
+    std::vector<int> cell_start;
+    std::vector<int> cell_objects;
+    std::vector<int> object_cell;
+};
+
+#endif//SOA_GRAVITY_H
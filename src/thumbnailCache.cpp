@@ -0,0 +1,122 @@
+#include "thumbnailCache.h"
+#include "fileUtil.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/filesystem.h>
+
+#include <sys/stat.h>
+#ifndef __WIN32__
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif//__WIN32__
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static const char thumbnail_magic[8] = {'A', 'R', 'C', 'T', 'H', 'M', 'B', '1'};
+
+
+ThumbnailCache::ThumbnailCache(sp::string directory)
+: directory(directory)
+{
+}
+
+bool ThumbnailCache::load(sp::string name, sp::string source_file, sp::Image& image)
+{
+    int64_t source_size, source_mtime;
+    if (!getSourceKey(source_file, source_size, source_mtime))
+        return false;
+
+#ifdef __WIN32__
+    //No mmap, read the whole file instead.
+    FILE* f = fopen(getFilename(name).c_str(), "rb");
+    if (!f)
+        return false;
+    std::vector<uint32_t> buffer;
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bool read_ok = file_size >= long(sizeof(Header));
+    if (read_ok)
+    {
+        buffer.resize((file_size + 3) / 4);
+        read_ok = fread(buffer.data(), file_size, 1, f) == 1;
+    }
+    fclose(f);
+    if (!read_ok)
+        return false;
+    const void* data = buffer.data();
+    size_t size = file_size;
+#else
+    int fd = open(getFilename(name).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || size_t(info.st_size) < sizeof(Header))
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+#endif//__WIN32__
+
+    const Header* header = static_cast<const Header*>(data);
+    bool valid = memcmp(header->magic, thumbnail_magic, sizeof(thumbnail_magic)) == 0
+        && header->source_size == source_size && header->source_mtime == source_mtime
+        && header->width > 0 && header->height > 0
+        && size == sizeof(Header) + size_t(header->width) * header->height * 4;
+    if (valid)
+        image.update(sp::Vector2i(header->width, header->height), reinterpret_cast<const uint32_t*>(header + 1));
+#ifndef __WIN32__
+    munmap(data, size);
+#endif//__WIN32__
+    return valid;
+}
+
+void ThumbnailCache::store(sp::string name, sp::string source_file, const sp::Image& image)
+{
+    Header header;
+    memcpy(header.magic, thumbnail_magic, sizeof(thumbnail_magic));
+    header.width = image.getSize().x;
+    header.height = image.getSize().y;
+    if (!getSourceKey(source_file, header.source_size, header.source_mtime))
+        return;
+
+    sp::io::makeDirectory(directory);
+    sp::string filename = getFilename(name);
+    FILE* f = fopen((filename + ".tmp").c_str(), "wb");
+    if (!f)
+        return;
+    bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+    success = success && fwrite(image.getPtr(), size_t(header.width) * header.height * 4, 1, f) == 1;
+    success = fclose(f) == 0 && success;
+    if (!success || !replaceFile(filename + ".tmp", filename))
+    {
+        LOG(Warning, "Failed to store thumbnail for", name);
+        remove((filename + ".tmp").c_str());
+    }
+}
+
+bool ThumbnailCache::getSourceKey(sp::string source_file, int64_t& size, int64_t& mtime)
+{
+    struct stat info;
+    if (stat(source_file.c_str(), &info) < 0)
+        return false;
+    size = info.st_size;
+#ifdef __WIN32__
+    mtime = int64_t(info.st_mtime) * 1000000000;
+#else
+    mtime = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif//__WIN32__
+    return true;
+}
+
+sp::string ThumbnailCache::getFilename(sp::string name)
+{
+    return directory + "/" + name + ".thumb";
+}
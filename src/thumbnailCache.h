@@ -0,0 +1,33 @@
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <sp2/image.h>
+
+//Stores the scaled down preview of every game in its own file, as raw RGBA pixels ready to be uploaded.
+//An entry is only used while the size and modification time of the preview file still match,
+//so on a warm boot the previews are available before any git or build work, without decoding a single PNG.
+class ThumbnailCache
+{
+public:
+    ThumbnailCache(sp::string directory);
+
+    bool load(sp::string name, sp::string source_file, sp::Image& image);
+    void store(sp::string name, sp::string source_file, const sp::Image& image);
+private:
+    class Header
+    {
+    public:
+        char magic[8];
+        int32_t width;
+        int32_t height;
+        int64_t source_size;
+        int64_t source_mtime;
+    };
+
+    static bool getSourceKey(sp::string source_file, int64_t& size, int64_t& mtime);
+    sp::string getFilename(sp::string name);
+
+    sp::string directory;
+};
+
+#endif//THUMBNAIL_CACHE_H
@@ -0,0 +1,208 @@
+#include "trace.h"
+#include "fileUtil.h"
+
+#include <sp2/logging.h>
+
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+
+namespace {
+
+class Event
+{
+public:
+    const char* name;
+    char detail[96];
+    int64_t start;      //microseconds since the trace was enabled
+    int64_t duration;   //microseconds
+};
+
+//One event in the ring buffer, guarded by a sequence lock. The event is copied in and out as relaxed atomic words.
+//sequence is odd while the owning thread writes the slot, and 2 * (n + 1) once event n is complete.
+//A reader that finds another sequence after its copy knows the slot was overwritten during the copy, and skips the event.
+class Slot
+{
+public:
+    static constexpr size_t word_count = sizeof(Event) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> words[word_count];
+};
+static_assert(sizeof(Event) % sizeof(uint64_t) == 0, "Trace events are copied as whole words");
+
+//Only its own thread adds events, so adding never waits. count is the total number of events added, event n is stored at n % max_events.
+class ThreadBuffer
+{
+public:
+    static constexpr uint32_t max_events = 16384;
+
+    int thread_index;
+    std::atomic<uint64_t> count{0};
+    Slot slots[max_events];
+};
+
+std::mutex buffers_mutex;
+std::vector<ThreadBuffer*> buffers;   //Never freed, a thread can end while its spans still have to be written.
+sp::string trace_filename;
+Trace::Clock::time_point trace_start;
+
+ThreadBuffer* getThreadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        buffer = new ThreadBuffer();
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffer->thread_index = buffers.size() + 1;
+        buffers.push_back(buffer);
+    }
+    return buffer;
+}
+
+int64_t toMicroseconds(Trace::Clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+//Copy event index out of the buffer. Returns false when the thread overwrote it, before or during the copy.
+bool readEvent(ThreadBuffer* buffer, uint64_t index, Event& event)
+{
+    Slot& slot = buffer->slots[index % ThreadBuffer::max_events];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != index * 2 + 2)
+        return false;
+    uint64_t words[Slot::word_count];
+    for(size_t n=0; n<Slot::word_count; n++)
+        words[n] = slot.words[n].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+        return false;
+    memcpy(&event, words, sizeof(event));
+    return true;
+}
+
+void writeJsonString(FILE* f, const char* str)
+{
+    fputc('"', f);
+    for(; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(f, "\\%c", *str);
+        else if (uint8_t(*str) < 0x20)
+            fprintf(f, "\\u%04x", *str);
+        else
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+}
+
+std::atomic<bool> Trace::enabled{false};
+
+void Trace::enable(sp::string filename)
+{
+    trace_filename = filename;
+    trace_start = Clock::now();
+    enabled = true;
+    LOG(Info, "Tracing to", filename);
+}
+
+void Trace::addSpan(const char* name, const sp::string& detail, Clock::time_point start, Clock::time_point end)
+{
+    if (!isEnabled())
+        return;
+    ThreadBuffer* buffer = getThreadBuffer();
+    Event event;
+    event.name = name;
+    //Long details are cut off, they only have to tell which game or command the span was for.
+    strncpy(event.detail, detail.c_str(), sizeof(event.detail) - 1);
+    event.detail[sizeof(event.detail) - 1] = '\0';
+    event.start = toMicroseconds(start - trace_start);
+    event.duration = toMicroseconds(end - start);
+
+    uint64_t index = buffer->count.load(std::memory_order_relaxed);
+    Slot& slot = buffer->slots[index % ThreadBuffer::max_events];
+    uint64_t words[Slot::word_count];
+    memcpy(words, &event, sizeof(event));
+    slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(size_t n=0; n<Slot::word_count; n++)
+        slot.words[n].store(words[n], std::memory_order_relaxed);
+    slot.sequence.store(index * 2 + 2, std::memory_order_release);
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+bool Trace::write()
+{
+    if (!isEnabled())
+        return false;
+    std::vector<ThreadBuffer*> threads;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        threads = buffers;
+    }
+    FILE* f = fopen((trace_filename + ".tmp").c_str(), "wt");
+    if (!f)
+    {
+        LOG(Warning, "Failed to write trace to", trace_filename);
+        return false;
+    }
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for(ThreadBuffer* buffer : threads)
+    {
+        //The thread keeps recording while we read, events it overwrites in the meantime are skipped.
+        uint64_t count = buffer->count.load(std::memory_order_acquire);
+        uint64_t overwritten = count > ThreadBuffer::max_events ? count - ThreadBuffer::max_events : 0;
+        for(uint64_t n=overwritten; n<count; n++)
+        {
+            Event event;
+            if (!readEvent(buffer, n, event))
+            {
+                overwritten++;
+                continue;
+            }
+            fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+            writeJsonString(f, event.name);
+            fprintf(f, ",\"cat\":\"arcade\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld", buffer->thread_index, (long long)event.start, (long long)event.duration);
+            if (event.detail[0])
+            {
+                fprintf(f, ",\"args\":{\"detail\":");
+                writeJsonString(f, event.detail);
+                fprintf(f, "}");
+            }
+            fprintf(f, "}");
+            first = false;
+        }
+        if (overwritten > 0)
+            LOG(Warning, "Trace buffer of thread", buffer->thread_index, "is full, its oldest spans were overwritten");
+    }
+    fprintf(f, "\n]}\n");
+    bool success = fclose(f) == 0;
+    if (!success || !replaceFile(trace_filename + ".tmp", trace_filename))
+    {
+        LOG(Warning, "Failed to write trace to", trace_filename);
+        remove((trace_filename + ".tmp").c_str());
+        return false;
+    }
+    return true;
+}
+
+TraceSpan::TraceSpan(const char* name, const sp::string& detail)
+: name(name)
+{
+    if (!Trace::isEnabled())
+        return;
+    this->detail = detail;
+    start = Trace::Clock::now();
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (Trace::isEnabled() && start != Trace::Clock::time_point())
+        Trace::addSpan(name, detail, start, Trace::Clock::now());
+}
@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sp2/string.h>
+#include <chrono>
+#include <atomic>
+
+//Records spans of where the launcher spends its time, and writes them as Chrome trace event JSON,
+//which can be opened in chrome://tracing or ui.perfetto.dev. Disabled unless started with --trace=<file>.
+//Every thread records into its own ring buffer without taking a lock. A full buffer overwrites the oldest spans of that thread,
+//so the trace always ends with the most recent spans.
+class Trace
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    //Start recording, the trace is written to filename by write().
+    static void enable(sp::string filename);
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    //Record a span that was timed by the caller, for spans that do not fit in a single scope.
+    static void addSpan(const char* name, const sp::string& detail, Clock::time_point start, Clock::time_point end);
+    //Write everything recorded so far. Can be called while other threads keep recording.
+    static bool write();
+private:
+    static std::atomic<bool> enabled;
+};
+
+//Records the time from construction to destruction as a span. name has to be a string literal.
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name, const sp::string& detail="");
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    const char* name;
+    sp::string detail;
+    Trace::Clock::time_point start;
+};
+
+#endif//TRACE_H
@@ -1,44 +1,179 @@
 #include "unfocusedKeyInfo.h"
 
+#include <sp2/logging.h>
+#include <chrono>
+
 #ifdef __WIN32__
-#include <stdint.h>
 #include <windows.h>
 #else
 #include <X11/Xlib.h>
+#include <poll.h>
+#ifdef ARCADE_XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif//ARCADE_XINPUT2
 #endif//__WIN32__
 
+static constexpr int exit_keycode = 51;
 
-bool isAnyKeyPressed()
+static int64_t now()
 {
-#ifdef __WIN32__
-    uint8_t keys[256];
-    GetKeyboardState(keys);
-    for(int n=0; n<256;n++)
-        if (keys[n] & 0x80)
-            return true;
-#else
-    Display* display = XOpenDisplay(nullptr);
-    char keys[32];
-    XQueryKeymap(display, keys);
-    XCloseDisplay(display);
-    for(int n=0; n<32; n++)
-        if (keys[n])
-            return true;
-#endif
-    return false;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void UnfocusedKeyMonitor::start()
+{
+    if (running)
+        return;
+    resetInactivity();
+    running = true;
+    thread = std::thread(&UnfocusedKeyMonitor::run, this);
 }
 
-bool isExitKeyPressed()
+void UnfocusedKeyMonitor::stop()
 {
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+float UnfocusedKeyMonitor::getInactivityTime()
+{
+    return float(now() - last_activity.load(std::memory_order_relaxed)) / 1000.0f;
+}
+
+void UnfocusedKeyMonitor::resetInactivity()
+{
+    last_activity.store(now(), std::memory_order_relaxed);
+}
+
+bool UnfocusedKeyMonitor::takeExitRequest()
+{
+    return exit_requested.exchange(false);
+}
+
+void UnfocusedKeyMonitor::setExitCallback(std::function<void()> callback)
+{
+    exit_callback = callback;
+}
+
+void UnfocusedKeyMonitor::onKeyPress(int keycode)
+{
+    last_activity.store(now(), std::memory_order_relaxed);
+    if (keycode == exit_keycode)
+    {
+        exit_requested.store(true);
+        if (exit_callback)
+            exit_callback();
+    }
+}
+
 #ifdef __WIN32__
-    uint8_t keys[256];
-    GetKeyboardState(keys);
-    return keys[51];
+void UnfocusedKeyMonitor::run()
+{
+    while(running)
+    {
+        uint8_t keys[256];
+        GetKeyboardState(keys);
+        for(int n=0; n<256;n++)
+            if (keys[n] & 0x80)
+                onKeyPress(n);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
 #else
+void UnfocusedKeyMonitor::run()
+{
     Display* display = XOpenDisplay(nullptr);
-    char keys[32];
-    XQueryKeymap(display, keys);
+    if (!display)
+    {
+        LOG(Error, "Failed to open X display for key monitoring");
+        running = false;
+        return;
+    }
+
+    bool raw_events = false;
+#ifdef ARCADE_XINPUT2
+    int xi_opcode, xi_event, xi_error;
+    if (XQueryExtension(display, "XInputExtension", &xi_opcode, &xi_event, &xi_error))
+    {
+        //Before XI 2.1 raw events are not delivered while another client grabs the keyboard, which fullscreen games often do.
+        int major = 2;
+        int minor = 2;
+        if (XIQueryVersion(display, &major, &minor) == Success && (major > 2 || (major == 2 && minor >= 1)))
+        {
+            //Raw events are delivered to the root window no matter which window has focus.
+            unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)] = {0};
+            XISetMask(mask_bits, XI_RawKeyPress);
+            XISetMask(mask_bits, XI_RawKeyRelease);
+            XIEventMask mask;
+            mask.deviceid = XIAllMasterDevices;
+            mask.mask_len = sizeof(mask_bits);
+            mask.mask = mask_bits;
+            XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+            XFlush(display);
+            raw_events = true;
+        }
+        else
+        {
+            LOG(Warning, "XInput", major, ".", minor, "is too old to see keys while a game grabs the keyboard");
+        }
+    }
+    //Raw events do not repeat, so keys that are held down are tracked to keep counting them as activity.
+    bool held[256] = {false};
+#endif//ARCADE_XINPUT2
+    if (!raw_events)
+        LOG(Warning, "XInput2 raw events not available, polling the keyboard state");
+
+    while(running)
+    {
+#ifdef ARCADE_XINPUT2
+        if (raw_events)
+        {
+            while(XPending(display))
+            {
+                XEvent event;
+                XNextEvent(display, &event);
+                XGenericEventCookie* cookie = &event.xcookie;
+                if (cookie->type == GenericEvent && cookie->extension == xi_opcode && XGetEventData(display, cookie))
+                {
+                    int keycode = static_cast<XIRawEvent*>(cookie->data)->detail;
+                    if (cookie->evtype == XI_RawKeyPress)
+                    {
+                        if (keycode >= 0 && keycode < 256)
+                            held[keycode] = true;
+                        onKeyPress(keycode);
+                    }
+                    else if (cookie->evtype == XI_RawKeyRelease && keycode >= 0 && keycode < 256)
+                    {
+                        held[keycode] = false;
+                    }
+                    XFreeEventData(display, cookie);
+                }
+            }
+            //The timeout only limits how long stop() has to wait, events wake us up directly.
+            pollfd fd;
+            fd.fd = ConnectionNumber(display);
+            fd.events = POLLIN;
+            fd.revents = 0;
+            poll(&fd, 1, 100);
+            for(bool key_held : held)
+            {
+                if (key_held)
+                {
+                    last_activity.store(now(), std::memory_order_relaxed);
+                    break;
+                }
+            }
+            continue;
+        }
+#endif//ARCADE_XINPUT2
+        char keys[32];
+        XQueryKeymap(display, keys);
+        for(int n=0; n<32 * 8; n++)
+            if (keys[n / 8] & (1 << (n % 8)))
+                onKeyPress(n);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
     XCloseDisplay(display);
-    return keys[51 / 8] & (1 << (51 % 8));
-#endif
 }
+#endif//__WIN32__
@@ -1,7 +1,36 @@
 #ifndef UNFOCUSED_KEY_INFO_H
 #define UNFOCUSED_KEY_INFO_H
 
-bool isAnyKeyPressed();
-bool isExitKeyPressed();
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <stdint.h>
+
+//Watches the keyboard while the launcher does not have focus, for example while a game is running.
+//A single background thread keeps one connection to the X server open and listens for raw key events,
+//the results are published with atomics so they can be read from any thread without locking.
+class UnfocusedKeyMonitor
+{
+public:
+    void start();
+    void stop();
+
+    //Seconds since a key was last pressed.
+    float getInactivityTime();
+    void resetInactivity();
+    //True when the exit key was pressed since the last call.
+    bool takeExitRequest();
+    //Called from the monitor thread when the exit key is pressed. Has to be set before start().
+    void setExitCallback(std::function<void()> callback);
+private:
+    void run();
+    void onKeyPress(int keycode);
+
+    std::atomic<int64_t> last_activity{0};
+    std::atomic<bool> exit_requested{false};
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::function<void()> exit_callback;
+};
 
 #endif//UNFOCUSED_KEY_INFO_H
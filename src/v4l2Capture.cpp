@@ -0,0 +1,187 @@
+#include "v4l2Capture.h"
+
+#include <sp2/logging.h>
+
+#ifdef __linux__
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static constexpr int buffer_count = 6;
+
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+    int result;
+    do
+    {
+        result = ioctl(fd, request, arg);
+    } while(result < 0 && errno == EINTR);
+    return result;
+}
+#endif//__linux__
+
+V4L2Capture::V4L2Capture()
+{
+}
+
+V4L2Capture::~V4L2Capture()
+{
+    close();
+}
+
+#ifdef __linux__
+bool V4L2Capture::open(int camera_index, sp::Vector2i requested_size)
+{
+    close();
+
+    char device[32];
+    snprintf(device, sizeof(device), "/dev/video%d", camera_index);
+    fd = ::open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    v4l2_capability capability;
+    memset(&capability, 0, sizeof(capability));
+    if (xioctl(fd, VIDIOC_QUERYCAP, &capability) < 0 || !(capability.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(capability.capabilities & V4L2_CAP_STREAMING))
+    {
+        LOG(Info, device, "does not support streaming capture");
+        close();
+        return false;
+    }
+
+    //Prefer YUYV, which almost every webcam supports, and fall back to NV12.
+    bool format_set = false;
+    for(uint32_t pixel_format : {V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12})
+    {
+        v4l2_format fmt;
+        memset(&fmt, 0, sizeof(fmt));
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = requested_size.x;
+        fmt.fmt.pix.height = requested_size.y;
+        fmt.fmt.pix.pixelformat = pixel_format;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        if (xioctl(fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != pixel_format)
+            continue;
+        format = pixel_format == V4L2_PIX_FMT_YUYV ? Format::YUYV : Format::NV12;
+        size = sp::Vector2i(fmt.fmt.pix.width, fmt.fmt.pix.height);
+        stride = fmt.fmt.pix.bytesperline;
+        frame_bytes = fmt.fmt.pix.sizeimage;
+        format_set = true;
+        break;
+    }
+    if (!format_set)
+    {
+        LOG(Info, device, "supports no raw YUYV or NV12 format");
+        close();
+        return false;
+    }
+
+    v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.count = buffer_count;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    //We can hold up to 3 buffers at the same time (triple buffering), so the driver needs more then that to keep streaming.
+    if (xioctl(fd, VIDIOC_REQBUFS, &request) < 0 || request.count < 4)
+    {
+        LOG(Error, device, "failed to allocate capture buffers");
+        close();
+        return false;
+    }
+    for(unsigned int n=0; n<request.count; n++)
+    {
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = n;
+        if (xioctl(fd, VIDIOC_QUERYBUF, &buffer) < 0)
+        {
+            close();
+            return false;
+        }
+        void* data = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
+        if (data == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        buffers.push_back({data, buffer.length});
+        enqueue(n);
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd, VIDIOC_STREAMON, &type) < 0)
+    {
+        LOG(Error, device, "failed to start streaming");
+        close();
+        return false;
+    }
+    LOG(Info, device, "streaming", format == Format::YUYV ? "YUYV" : "NV12", size.x, size.y);
+    return true;
+}
+
+void V4L2Capture::close()
+{
+    if (fd < 0)
+        return;
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(fd, VIDIOC_STREAMOFF, &type);
+    for(auto& buffer : buffers)
+        munmap(buffer.data, buffer.length);
+    buffers.clear();
+    ::close(fd);
+    fd = -1;
+}
+
+int V4L2Capture::dequeue(int timeout_ms)
+{
+    pollfd poll_fd;
+    poll_fd.fd = fd;
+    poll_fd.events = POLLIN;
+    poll_fd.revents = 0;
+    if (poll(&poll_fd, 1, timeout_ms) <= 0)
+        return -1;
+
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd, VIDIOC_DQBUF, &buffer) < 0)
+        return -1;
+    return buffer.index;
+}
+
+void V4L2Capture::enqueue(int index)
+{
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = index;
+    xioctl(fd, VIDIOC_QBUF, &buffer);
+}
+#else//__linux__
+bool V4L2Capture::open(int camera_index, sp::Vector2i requested_size)
+{
+    return false;
+}
+
+void V4L2Capture::close()
+{
+}
+
+int V4L2Capture::dequeue(int timeout_ms)
+{
+    return -1;
+}
+
+void V4L2Capture::enqueue(int index)
+{
+}
+#endif//__linux__
@@ -0,0 +1,53 @@
+#ifndef V4L2_CAPTURE_H
+#define V4L2_CAPTURE_H
+
+#include <sp2/math/vector.h>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+//Streams raw YUYV or NV12 frames from a video4linux device, without any conversion.
+//Buffers are memory mapped from the driver, a dequeued buffer stays ours until it is enqueued again.
+class V4L2Capture
+{
+public:
+    enum class Format
+    {
+        YUYV,
+        NV12
+    };
+
+    V4L2Capture();
+    ~V4L2Capture();
+
+    bool open(int camera_index, sp::Vector2i requested_size=sp::Vector2i(640, 480));
+    void close();
+    bool isOpen() { return fd >= 0; }
+
+    //Wait for the next frame, returns the buffer index or -1 on timeout.
+    int dequeue(int timeout_ms);
+    void enqueue(int index);
+
+    const uint8_t* getData(int index) { return static_cast<const uint8_t*>(buffers[index].data); }
+    size_t getFrameBytes() { return frame_bytes; }
+    Format getFormat() { return format; }
+    sp::Vector2i getSize() { return size; }
+    //Bytes per row of the (first) plane.
+    int getStride() { return stride; }
+private:
+    class Buffer
+    {
+    public:
+        void* data;
+        size_t length;
+    };
+
+    int fd = -1;
+    std::vector<Buffer> buffers;
+    Format format = Format::YUYV;
+    sp::Vector2i size;
+    int stride = 0;
+    size_t frame_bytes = 0;
+};
+
+#endif//V4L2_CAPTURE_H
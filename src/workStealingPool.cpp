@@ -0,0 +1,104 @@
+#include "workStealingPool.h"
+
+#include <algorithm>
+
+
+WorkStealingPool::WorkStealingPool(int thread_count)
+{
+    for(int n=0; n<thread_count; n++)
+        queues.emplace_back(new Queue());
+    //Queue 0 belongs to the thread calling parallelFor.
+    for(int n=1; n<thread_count; n++)
+        threads.emplace_back(&WorkStealingPool::workerMain, this, n);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for(auto& thread : threads)
+        thread.join();
+}
+
+void WorkStealingPool::parallelFor(int count, int grain_size, const std::function<void(int, int)>& function)
+{
+    if (count <= 0)
+        return;
+    //The function is set before any range is queued, the queue mutex makes it visible to the thread that takes the range.
+    this->function = &function;
+    int range_count = (count + grain_size - 1) / grain_size;
+    remaining = range_count;
+    for(int n=0; n<range_count; n++)
+    {
+        Queue& queue = *queues[n % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.ranges.push_back({n * grain_size, std::min(count, (n + 1) * grain_size)});
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+    }
+    condition.notify_all();
+
+    while(runRange(0))
+    {
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this]() { return remaining == 0; });
+}
+
+void WorkStealingPool::workerMain(int index)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    int seen_generation = generation;
+    while(true)
+    {
+        condition.wait(lock, [this, seen_generation]() { return stopping || generation != seen_generation; });
+        if (stopping)
+            return;
+        seen_generation = generation;
+        lock.unlock();
+        while(runRange(index))
+        {
+        }
+        lock.lock();
+    }
+}
+
+bool WorkStealingPool::runRange(int index)
+{
+    Range range;
+    bool found = false;
+    //Take the most recently queued range of our own queue, or the oldest range of an other queue.
+    for(unsigned int n=0; n<queues.size() && !found; n++)
+    {
+        Queue& queue = *queues[(index + n) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.ranges.empty())
+            continue;
+        if (n == 0)
+        {
+            range = queue.ranges.back();
+            queue.ranges.pop_back();
+        }
+        else
+        {
+            range = queue.ranges.front();
+            queue.ranges.pop_front();
+        }
+        found = true;
+    }
+    if (!found)
+        return false;
+
+    (*function)(range.begin, range.end);
+    if (--remaining == 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done_condition.notify_all();
+    }
+    return true;
+}
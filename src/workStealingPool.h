@@ -0,0 +1,52 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+//Splits loops over a fixed amount of threads, the calling thread included.
+//Every thread has its own queue of ranges, and takes work from the other queues when its own queue runs empty, so uneven ranges still keep all threads busy.
+class WorkStealingPool
+{
+public:
+    WorkStealingPool(int thread_count);
+    ~WorkStealingPool();
+
+    int getThreadCount() const { return queues.size(); }
+
+    //Call function(begin, end) for ranges of at most grain_size covering [0, count), and return when all of them are done.
+    void parallelFor(int count, int grain_size, const std::function<void(int, int)>& function);
+private:
+    struct Range
+    {
+        int begin;
+        int end;
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    void workerMain(int index);
+    bool runRange(int index);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    const std::function<void(int, int)>* function = nullptr;
+    std::atomic<int> remaining{0};
+    int generation = 0;
+    bool stopping = false;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable done_condition;
+    std::vector<std::thread> threads;
+};
+
+#endif//WORK_STEALING_POOL_H
@@ -0,0 +1,128 @@
+//Runs the git backends against a local bare repository, which stands in for GitHub.
+//Clones it, pushes a new commit to it, and checks every backend picks that commit up on the next update.
+//Needs the git executable to create the fixture. Exits with a non-zero status when a check fails.
+#include "../src/gitBackend.h"
+#include "../src/buildLog.h"
+
+#include <sp2/logging.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static int failures = 0;
+
+static void check(bool condition, sp::string backend, sp::string description)
+{
+    if (condition)
+    {
+        printf("ok: %s: %s\n", backend.c_str(), description.c_str());
+    }
+    else
+    {
+        printf("FAILED: %s: %s\n", backend.c_str(), description.c_str());
+        failures++;
+    }
+}
+
+static bool git(sp::string arguments)
+{
+    return system(("git " + arguments + " > /dev/null 2>&1").c_str()) == 0;
+}
+
+static sp::string revParse(sp::string directory)
+{
+    sp::string result;
+    FILE* f = popen(("git -C " + directory + " rev-parse HEAD").c_str(), "r");
+    if (!f)
+        return result;
+    char buffer[128];
+    if (fgets(buffer, sizeof(buffer), f))
+        result = sp::string(buffer).strip();
+    pclose(f);
+    return result;
+}
+
+//Commit a file with the given content in the work checkout, and push it to the bare repository.
+static bool pushCommit(sp::string work, sp::string content)
+{
+    FILE* f = fopen((work + "/file.txt").c_str(), "wt");
+    if (!f)
+        return false;
+    fprintf(f, "%s\n", content.c_str());
+    fclose(f);
+    return git("-C " + work + " add file.txt")
+        && git("-C " + work + " -c user.name=test -c user.email=test@localhost commit -m \"" + content + "\"")
+        && git("-C " + work + " push origin HEAD:main");
+}
+
+static bool hasLine(BuildLog& log, sp::string line)
+{
+    for(auto& log_line : log.getLines())
+        if (log_line == line)
+            return true;
+    return false;
+}
+
+//checks_remote_first is set for backends that compare the remote branch with ls-remote before fetching.
+static void testBackend(sp::string name, GitBackend& backend, sp::string fixture, bool checks_remote_first)
+{
+    sp::string origin = fixture + "/origin.git";
+    sp::string work = fixture + "/work";
+    sp::string target = fixture + "/checkout_" + name;
+    BuildLog log;
+
+    check(pushCommit(work, name + " first"), name, "push first commit");
+    check(backend.update(origin, target, log), name, "clone");
+    sp::string first_commit = revParse(work);
+    check(backend.getHeadCommit(target) == first_commit, name, "head after clone");
+
+    check(pushCommit(work, name + " second"), name, "push second commit");
+    check(backend.update(origin, target, log), name, "pull");
+    check(backend.getHeadCommit(target) == revParse(work), name, "head after pull");
+
+    log.clear();
+    check(backend.update(origin, target, log), name, "pull without changes");
+    check(backend.getHeadCommit(target) == revParse(work), name, "head after pull without changes");
+    if (checks_remote_first)
+        check(hasLine(log, "Already up to date.") && !hasLine(log, "Fetching main"), name, "pull without changes only lists the remote refs");
+
+    //A failed build puts the checkout back at the commit of the last good build.
+    check(backend.reset(target, first_commit, log), name, "reset");
+    check(backend.getHeadCommit(target) == first_commit, name, "head after reset");
+    check(backend.update(origin, target, log), name, "pull after reset");
+    check(backend.getHeadCommit(target) == revParse(work), name, "head after pull after reset");
+
+    check(!backend.update(fixture + "/missing.git", fixture + "/checkout_missing_" + name, log), name, "clone of a missing repository fails");
+}
+
+int main(int argc, char** argv)
+{
+    char fixture_template[] = "/tmp/arcade_git_test_XXXXXX";
+    if (!mkdtemp(fixture_template))
+    {
+        printf("FAILED: cannot create fixture directory\n");
+        return 1;
+    }
+    sp::string fixture = fixture_template;
+    if (!git("init --bare " + fixture + "/origin.git")
+        || !git("--git-dir=" + fixture + "/origin.git symbolic-ref HEAD refs/heads/main")
+        || !git("init " + fixture + "/work")
+        || !git("-C " + fixture + "/work checkout -b main")
+        || !git("-C " + fixture + "/work remote add origin " + fixture + "/origin.git"))
+    {
+        printf("FAILED: cannot create fixture repositories in %s\n", fixture.c_str());
+        return 1;
+    }
+
+    SubprocessGitBackend subprocess_backend;
+    testBackend("subprocess", subprocess_backend, fixture, false);
+#ifdef ARCADE_LIBGIT2
+    LibGit2Backend libgit2_backend;
+    testBackend("libgit2", libgit2_backend, fixture, true);
+#endif//ARCADE_LIBGIT2
+
+    system(("rm -rf " + fixture).c_str());
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}